@@ -0,0 +1,69 @@
+//***************************************************************************************
+// Benchmark.h
+//
+// Pieces shared by the headless benchmarks and checks.  Each mode is a function that
+// Main.cpp runs by name with the remaining command line arguments; it prints its
+// results and returns the process exit code.
+//***************************************************************************************
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// Calls func iterations times, repeats times over, and returns the fastest repeat in
+// milliseconds per call.  The fastest rather than the mean keeps a repeat the OS
+// descheduled from skewing the small grids.
+template<class Func>
+double MillisecondsPerCall(int iterations, int repeats, const Func& func)
+{
+    double best = 0.0;
+    for(int r = 0; r < repeats; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(int k = 0; k < iterations; ++k)
+            func();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        double ms = elapsed.count() / iterations;
+        if(r == 0 || ms < best)
+            best = ms;
+    }
+
+    return best;
+}
+
+// Iterations for a pass over cellCount grid cells so that a repeat covers about
+// 2^26 cells, and at least a few calls.
+inline int IterationsForCells(int cellCount)
+{
+    int iterations = (1 << 26) / cellCount;
+    return iterations < 4 ? 4 : iterations;
+}
+
+// Value of the integer option name ("--threads 4") among args, or fallback.
+inline int IntOption(int argc, char* argv[], const char* name, int fallback)
+{
+    for(int i = 0; i + 1 < argc; ++i)
+    {
+        if(std::strcmp(argv[i], name) == 0)
+            return std::atoi(argv[i + 1]);
+    }
+
+    return fallback;
+}
+
+int RunWavesBenchmark(int argc, char* argv[]);
+int RunSchedulerBenchmark(int argc, char* argv[]);
+int RunOceanBenchmark(int argc, char* argv[]);
+int RunWaterSimThreadTest(int argc, char* argv[]);
+int RunImplicitBenchmark(int argc, char* argv[]);
+int RunStorageBenchmark(int argc, char* argv[]);
+int RunSubdivisionTest(int argc, char* argv[]);
+int RunGeometryBenchmark(int argc, char* argv[]);
+int RunLodStitchingTest(int argc, char* argv[]);
+int RunPackedVertexTest(int argc, char* argv[]);
+
+#endif // BENCHMARK_H
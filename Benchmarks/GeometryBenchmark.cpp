@@ -0,0 +1,84 @@
+//***************************************************************************************
+// GeometryBenchmark.cpp
+//
+// Time to generate large meshes with GeometryGenerator: a 2048^2 grid, a sphere and a
+// cylinder of 512 slices and stacks, and the geosphere at its largest subdivision.
+// Vertex and index counts are checked against their closed forms, and the meshes that
+// are sized up front must come out without spare capacity.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Common/GeometryGenerator.h"
+#include "../Common/TaskScheduler.h"
+#include <cstdio>
+#include <functional>
+
+namespace
+{
+    typedef GeometryGenerator::uint32 uint32;
+
+    struct Shape
+    {
+        const char* Name;
+        std::function<GeometryGenerator::MeshData(GeometryGenerator&)> Create;
+        std::size_t Vertices;
+        std::size_t Indices;
+
+        // Whether the arrays are sized once to their final size.
+        bool Exact;
+    };
+}
+
+int RunGeometryBenchmark(int argc, char* argv[])
+{
+    TaskScheduler scheduler(IntOption(argc, argv, "--threads", 0));
+    GeometryGenerator geoGen(&scheduler);
+
+    const uint32 gridSize = (uint32)IntOption(argc, argv, "--grid", 2048);
+    const uint32 slices = (uint32)IntOption(argc, argv, "--slices", 512);
+    const uint32 stacks = slices;
+    const uint32 subdivisions = 6;
+
+    const Shape shapes[] =
+    {
+        { "grid", [=](GeometryGenerator& g) { return g.CreateGrid(100.0f, 100.0f, gridSize, gridSize); },
+          (std::size_t)gridSize*gridSize, (std::size_t)6*(gridSize - 1)*(gridSize - 1), true },
+
+        // A ring of slices + 1 vertices per inner stack boundary, plus the poles.
+        { "sphere", [=](GeometryGenerator& g) { return g.CreateSphere(1.0f, slices, stacks); },
+          (std::size_t)(stacks - 1)*(slices + 1) + 2, (std::size_t)6*slices*(stacks - 1), true },
+
+        // stacks + 1 rings, then each cap's ring and center.
+        { "cylinder", [=](GeometryGenerator& g) { return g.CreateCylinder(1.0f, 0.5f, 2.0f, slices, stacks); },
+          (std::size_t)(stacks + 1)*(slices + 1) + 2*(slices + 2), (std::size_t)6*slices*stacks + 6*slices, true },
+
+        // The icosahedron's 12 vertices and 20 faces, subdivided.
+        { "geosphere", [=](GeometryGenerator& g) { return g.CreateGeosphere(1.0f, subdivisions); },
+          ((std::size_t)10 << (2*subdivisions)) + 2, (std::size_t)60 << (2*subdivisions), false },
+    };
+
+    int threads = scheduler.ThreadCount();
+    std::printf("GeometryGenerator, %d thread%s; grid %u^2, sphere and cylinder %u slices and stacks,"
+        " geosphere %u subdivisions\n\n", threads, threads == 1 ? "" : "s", gridSize, slices, subdivisions);
+    std::printf("  shape       vertices     indices      ms   ns/vertex   sizes\n");
+
+    bool ok = true;
+    for(const Shape& shape : shapes)
+    {
+        // Timed meshes are freed again inside the call, so no call pays for
+        // releasing the one before.
+        GeometryGenerator::MeshData mesh = shape.Create(geoGen);
+        double ms = MillisecondsPerCall(1, 5, [&]() { shape.Create(geoGen); });
+
+        bool counts = mesh.Vertices.size() == shape.Vertices && mesh.Indices32.size() == shape.Indices;
+        bool exact = !shape.Exact || (mesh.Vertices.capacity() == mesh.Vertices.size() &&
+                                      mesh.Indices32.capacity() == mesh.Indices32.size());
+        ok &= counts && exact;
+
+        std::printf("  %-9s %10zu %11zu %7.2f %11.2f   %s\n", shape.Name, mesh.Vertices.size(), mesh.Indices32.size(),
+            ms, 1e6*ms / mesh.Vertices.size(),
+            !counts ? "FAILED: expected other counts" : !exact ? "FAILED: spare capacity" : "ok");
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+//***************************************************************************************
+// ImplicitBenchmark.cpp
+//
+// The implicit solver at 4 and 8 times the largest time step the explicit one is
+// stable at.  Checks that no implicit step raises Waves::ImplicitEnergy, and compares
+// the cost of a simulated second with the explicit solver just under its limit.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Common/TaskScheduler.h"
+#include "../lab assignment 1/Waves.h"
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+    // The app's wave constants.
+    const float SpatialStep = 1.0f;
+    const float Speed = 4.0f;
+    const float Damping = 0.2f;
+
+    // The explicit solver is stable while speed*dt/dx stays below 1/sqrt(2).
+    const float ExplicitLimit = SpatialStep / (Speed*std::sqrt(2.0f));
+
+    // Relative slack for float rounding in the sweeps; with damping the energy drops
+    // by far more than this every step.
+    const double EnergySlack = 1e-5;
+
+    void DisturbEverywhere(Waves& waves, int size)
+    {
+        for(int i = 4; i < size - 1; i += 8)
+        {
+            for(int j = 4; j < size - 1; j += 8)
+                waves.Disturb(i, j, ((i + j) & 1) ? 0.5f : -0.5f);
+        }
+    }
+}
+
+int RunImplicitBenchmark(int argc, char* argv[])
+{
+    TaskScheduler scheduler(IntOption(argc, argv, "--threads", 0));
+    int size = IntOption(argc, argv, "--size", 512);
+    int steps = IntOption(argc, argv, "--steps", 200);
+
+    int threads = scheduler.ThreadCount();
+    std::printf("Waves on a %d^2 grid, explicit limit dt = %.4f s, %d thread%s\n\n",
+        size, ExplicitLimit, threads, threads == 1 ? "" : "s");
+    std::printf("  solver     dt/limit   ms/step   ms per simulated s   energy after %d steps\n", steps);
+
+    struct Run
+    {
+        Waves::Solver Solver;
+        float LimitFraction;
+    };
+
+    const Run runs[] =
+    {
+        { Waves::Solver::Explicit, 0.9f },
+        { Waves::Solver::Implicit, 4.0f },
+        { Waves::Solver::Implicit, 8.0f },
+    };
+
+    bool stable = true;
+    for(const Run& run : runs)
+    {
+        bool implicit = run.Solver == Waves::Solver::Implicit;
+        float dt = run.LimitFraction*ExplicitLimit;
+
+        // Energy check, stepping one fixed step per Update.
+        Waves waves(size, size, SpatialStep, dt, Speed, Damping, &scheduler, run.Solver);
+        waves.SetMaxSubsteps(1);
+        waves.SetSleepThreshold(0.0f);
+        DisturbEverywhere(waves, size);
+        waves.Update(dt);
+
+        double initial = waves.ImplicitEnergy();
+        double energy = initial;
+        bool rose = false;
+        for(int k = 0; k < steps && implicit && !rose; ++k)
+        {
+            waves.Update(dt);
+
+            double next = waves.ImplicitEnergy();
+            if(!(next <= energy*(1.0 + EnergySlack)))
+            {
+                std::printf("  implicit %9.1fx: energy rose from %g to %g at step %d\n",
+                    run.LimitFraction, energy, next, k + 1);
+                rose = true;
+            }
+            energy = next;
+        }
+
+        if(rose)
+        {
+            stable = false;
+            continue;
+        }
+
+        double ms = MillisecondsPerCall(IterationsForCells(size*size) / 2 + 4, 5, [&waves, dt]() { waves.Update(dt); });
+
+        char energyText[32] = "-";
+        if(implicit)
+            std::snprintf(energyText, sizeof(energyText), "%.3g of initial", energy / initial);
+
+        std::printf("  %-8s %9.1fx %9.3f %20.1f   %s\n",
+            implicit ? "implicit" : "explicit", run.LimitFraction, ms, ms / dt, energyText);
+    }
+
+    return stable ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+//***************************************************************************************
+// LodStitchingTest.cpp
+//
+// Headless check of WavesLod::ValidateStitching over grid sizes that do and do not
+// divide into whole tiles, down to a 3x3 grid, with every tile at the same LOD and
+// with seeded random LODs that put every pair of strides next to each other.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../lab assignment 1/WavesLod.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+    struct GridCase
+    {
+        int Rows;
+        int Cols;
+        int TileQuads;
+    };
+
+    // Returns the number of LOD patterns that failed.
+    int CheckGrid(const GridCase& grid, int randomPatterns)
+    {
+        WavesLod lod(grid.Rows, grid.Cols, 1.0f, grid.TileQuads);
+        std::vector<std::uint32_t> indices(lod.MaxIndexCount());
+        std::mt19937 random(grid.Rows*1000 + grid.Cols);
+
+        int failures = 0;
+        for(int pattern = 0; pattern < WavesLod::LodCount + randomPatterns; ++pattern)
+        {
+            // SetTileLod clamps to what the tile is big enough for.
+            for(int k = 0; k < lod.TileCount(); ++k)
+            {
+                int level = pattern < WavesLod::LodCount ? pattern : (int)(random() % WavesLod::LodCount);
+                lod.SetTileLod(k, level);
+            }
+
+            if(!lod.ValidateStitching())
+            {
+                if(failures++ == 0)
+                    std::printf("  %dx%d, %d-quad tiles: pattern %d is not stitched\n", grid.Rows, grid.Cols, grid.TileQuads, pattern);
+            }
+        }
+
+        char size[32];
+        std::snprintf(size, sizeof(size), "%dx%d", grid.Rows, grid.Cols);
+        std::printf("  %9s %12d %7d   %s\n", size, grid.TileQuads, lod.TileCount(), failures == 0 ? "ok" : "FAILED");
+        return failures;
+    }
+}
+
+int RunLodStitchingTest(int argc, char* argv[])
+{
+    int randomPatterns = IntOption(argc, argv, "--patterns", 64);
+
+    const GridCase grids[] =
+    {
+        { 3, 3, 2 },        // a single tile that cannot go below LOD 0
+        { 3, 3, 32 },
+        { 9, 9, 2 },        // smallest tiles
+        { 33, 33, 32 },     // exactly one tile
+        { 65, 65, 32 },
+        { 129, 129, 8 },
+        { 100, 37, 32 },    // leftover quads on both axes, not square
+        { 50, 50, 7 },      // odd tile size
+        { 61, 75, 16 },
+        { 257, 257, 32 },
+    };
+
+    std::printf("WavesLod stitching, every LOD and %d random LOD patterns per grid\n\n", randomPatterns);
+    std::printf("       grid   tile quads   tiles\n");
+
+    int failures = 0;
+    for(const GridCase& grid : grids)
+        failures += CheckGrid(grid, randomPatterns);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+//***************************************************************************************
+// Main.cpp
+//
+// Headless benchmarks and checks of the CPU water and geometry code; they need neither
+// a GPU nor a window.
+//
+//   Benchmarks <mode> [options]
+//
+// Run without arguments for the list of modes.  Time the Release configuration; the
+// Debug configuration also runs the debug validation of the code under test.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    struct Mode
+    {
+        const char* Name;
+        const char* Description;
+        int (*Run)(int argc, char* argv[]);
+    };
+
+    const Mode Modes[] =
+    {
+        { "waves", "fused Waves::Update against the original two-pass update, and the height stencil alone"
+          " on AoS against SoA, 128^2 to 2048^2 [--threads n]", RunWavesBenchmark },
+        { "scheduler", "Waves::Update scaling from 1 to every hardware thread [--size n] [--max-threads n]",
+          RunSchedulerBenchmark },
+        { "ocean", "Ocean::Update at 256^2 and 512^2 [--threads n]", RunOceanBenchmark },
+        { "watersim", "checks that WaterSimThread never hands out a torn frame [--size n] [--frames n]",
+          RunWaterSimThreadTest },
+        { "implicit", "implicit solver energy at 4x and 8x the explicit dt limit, and cost per simulated second"
+          " [--size n] [--steps n] [--threads n]", RunImplicitBenchmark },
+        { "storage", "footprint, step time and error against Float32 of each Waves::Storage mode"
+          " [--size n] [--steps n] [--threads n]", RunStorageBenchmark },
+        { "subdivide", "checks that subdivided geospheres and boxes stay closed, with V - E + F == 2 [--threads n]",
+          RunSubdivisionTest },
+        { "geometry", "GeometryGenerator grid, sphere, cylinder and geosphere generation, with their sizes checked"
+          " [--grid n] [--slices n] [--threads n]", RunGeometryBenchmark },
+        { "lod", "checks WavesLod stitching on several grid sizes with uniform and random LODs [--patterns n]",
+          RunLodStitchingTest },
+        { "packed", "checks the PackedVertexLayout round trip of GeometryGenerator meshes against the error bounds",
+          RunPackedVertexTest },
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc >= 2)
+    {
+        for(const Mode& mode : Modes)
+        {
+            if(std::strcmp(argv[1], mode.Name) == 0)
+                return mode.Run(argc - 2, argv + 2);
+        }
+    }
+
+    std::printf("usage: Benchmarks <mode> [options]\n\n");
+    for(const Mode& mode : Modes)
+        std::printf("  %-10s %s\n", mode.Name, mode.Description);
+
+    return 1;
+}
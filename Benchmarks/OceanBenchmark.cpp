@@ -0,0 +1,36 @@
+//***************************************************************************************
+// OceanBenchmark.cpp
+//
+// Time per Ocean::Update, which evaluates the spectrum, runs the inverse 2D FFT and
+// computes the normals, at 256^2 and 512^2.  The cost is also given per N^2 log2 N
+// to show it grows as the FFT does.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Common/TaskScheduler.h"
+#include "../lab assignment 1/Ocean.h"
+#include <cmath>
+#include <cstdio>
+
+using namespace DirectX;
+
+int RunOceanBenchmark(int argc, char* argv[])
+{
+    TaskScheduler scheduler(IntOption(argc, argv, "--threads", 0));
+
+    int threads = scheduler.ThreadCount();
+    std::printf("Ocean update, %d thread%s\n\n", threads, threads == 1 ? "" : "s");
+    std::printf("  spectrum  ms/update  ns per N^2 log2 N\n");
+
+    for(int n : { 256, 512 })
+    {
+        Ocean ocean(n, 200.0f, 20.0f, XMFLOAT2(1.0f, 0.3f), 0.0005f, &scheduler);
+
+        double ms = MillisecondsPerCall(IterationsForCells(n*n) / 8 + 4, 5, [&ocean]() { ocean.Update(1.0f / 60.0f); });
+        double normalized = 1e6*ms / (n*n*std::log2((double)n));
+
+        std::printf("%8d^2 %10.3f %18.3f\n", n, ms, normalized);
+    }
+
+    return 0;
+}
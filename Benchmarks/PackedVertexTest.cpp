@@ -0,0 +1,194 @@
+//***************************************************************************************
+// PackedVertexTest.cpp
+//
+// Headless check of PackedVertexLayout on the shapes the app packs, and on larger
+// ones.  Each mesh is converted with its bounding box, as MeshBatchBuilder does, and
+// Layout::Verify must pass.  The vertices are then decoded the way Default.hlsl
+// does and compared with the originals:
+//
+//   position            within Extents/65534 per axis
+//   normal              within 3*sqrt(2)/65534 radians (about 0.0037 degrees)
+//   texture coordinate  within HalfError of each component
+//
+// The normal bound follows from the octahedral components being within 1/65534:
+// that moves the point on the octahedron by at most sqrt(6)/65534, and no point
+// of the octahedron is closer than 1/sqrt(3) to the origin.  Normals the generator
+// leaves zero must come back as +y.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Common/GeometryGenerator.h"
+#include "../lab assignment 1/VertexLayouts.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+    struct Shape
+    {
+        const char* Name;
+        std::function<GeometryGenerator::MeshData(GeometryGenerator&)> Create;
+    };
+
+    // How a stored vertex is laid out, element by element, for the decode below.
+    struct PackedVertex
+    {
+        XMSHORTN4 PosQ;
+        XMSHORTN2 NormalOct;
+        XMHALF2 TexC;
+    };
+
+    static_assert(sizeof(PackedVertex) == PackedVertexLayout::Stride, "PackedVertex does not match PackedVertexLayout.");
+
+    // DecodeOctahedral in Default.hlsl.
+    XMVECTOR DecodeOctahedral(float ex, float ey)
+    {
+        float x = ex;
+        float y = 1.0f - std::fabs(ex) - std::fabs(ey);
+        float z = ey;
+        if(y < 0.0f)
+        {
+            float foldX = (1.0f - std::fabs(z)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float foldZ = (1.0f - std::fabs(x)) * (z >= 0.0f ? 1.0f : -1.0f);
+            x = foldX;
+            z = foldZ;
+        }
+        return XMVector3Normalize(XMVectorSet(x, y, z, 0.0f));
+    }
+
+    // The largest errors over a mesh, positions relative to the bound of their axis.
+    struct Errors
+    {
+        float Position = 0.0f;
+        float NormalRadians = 0.0f;
+        float TexC = 0.0f;
+        int Failures = 0;
+    };
+
+    Errors Measure(const GeometryGenerator::MeshData& mesh, const VertexFormat::ConvertContext& context,
+                   const std::vector<PackedVertex>& packed)
+    {
+        const float normalBound = 3.0f*std::sqrt(2.0f) / 65534.0f + 1e-6f;
+
+        const XMFLOAT3& center = context.Bounds.Center;
+        const XMFLOAT3& extents = context.Bounds.Extents;
+        const float c[3] = { center.x, center.y, center.z };
+        const float e[3] = { extents.x, extents.y, extents.z };
+
+        Errors errors;
+        for(std::size_t i = 0; i < mesh.Vertices.size(); ++i)
+        {
+            const GeometryGenerator::Vertex& v = mesh.Vertices[i];
+            bool ok = true;
+
+            // posL = gBoundsCenter + gBoundsExtents * PosQ.xyz
+            XMFLOAT4 q;
+            XMStoreFloat4(&q, XMLoadShortN4(&packed[i].PosQ));
+            const float qs[3] = { q.x, q.y, q.z };
+            const float p[3] = { v.Position.x, v.Position.y, v.Position.z };
+            for(int k = 0; k < 3; ++k)
+            {
+                float bound = e[k] / 65534.0f;
+                float slack = 4.0f*FLT_EPSILON*(std::fabs(c[k]) + e[k]);
+                float error = std::fabs(c[k] + e[k]*qs[k] - p[k]);
+                if(bound > 0.0f)
+                    errors.Position = std::max(errors.Position, error / bound);
+                ok = ok && error <= bound + slack;
+            }
+
+            XMFLOAT2 oct;
+            XMStoreFloat2(&oct, XMLoadShortN2(&packed[i].NormalOct));
+            XMVECTOR decoded = DecodeOctahedral(oct.x, oct.y);
+            XMVECTOR original = XMLoadFloat3(&v.Normal);
+            if(XMVectorGetX(XMVector3LengthSq(original)) == 0.0f)
+            {
+                ok = ok && XMVector3NearEqual(decoded, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), XMVectorReplicate(1e-6f));
+            }
+            else
+            {
+                // From the cross product, since the cosine of angles this small
+                // rounds to 1 in float.
+                XMVECTOR n = XMVector3Normalize(original);
+                float angle = std::atan2(XMVectorGetX(XMVector3Length(XMVector3Cross(decoded, n))),
+                                         XMVectorGetX(XMVector3Dot(decoded, n)));
+                errors.NormalRadians = std::max(errors.NormalRadians, angle);
+                ok = ok && angle <= normalBound;
+            }
+
+            XMFLOAT2 uv;
+            XMStoreFloat2(&uv, XMLoadHalf2(&packed[i].TexC));
+            float du = std::fabs(uv.x - v.TexC.x);
+            float dv = std::fabs(uv.y - v.TexC.y);
+            errors.TexC = std::max(errors.TexC, std::max(du / VertexFormat::HalfError(v.TexC.x),
+                                                         dv / VertexFormat::HalfError(v.TexC.y)));
+            ok = ok && du <= VertexFormat::HalfError(v.TexC.x) && dv <= VertexFormat::HalfError(v.TexC.y);
+
+            errors.Failures += !ok;
+        }
+
+        return errors;
+    }
+}
+
+int RunPackedVertexTest(int, char*[])
+{
+    GeometryGenerator geoGen;
+
+    // The shapes as the app builds them, then bigger and off-center ones.
+    const Shape shapes[] =
+    {
+        { "box", [](GeometryGenerator& g) { return g.CreateBox(1.0f, 1.0f, 1.0f, 3); } },
+        { "grid", [](GeometryGenerator& g) { return g.CreateGrid(60.0f, 60.0f, 60, 40); } },
+        { "sphere", [](GeometryGenerator& g) { return g.CreateSphere(1.0f, 20, 20); } },
+        { "cylinder", [](GeometryGenerator& g) { return g.CreateCylinder(1.0f, 1.0f, 1.0f, 20, 20); } },
+        { "cone", [](GeometryGenerator& g) { return g.CreateCone(1.0f, 1.0f, 20, 20); } },
+        { "wedge", [](GeometryGenerator& g) { return g.CreateWedge(1.0f, 1.0f, 1.0f, 3); } },
+        { "pyramid", [](GeometryGenerator& g) { return g.CreatePyramid(1.0f, 1.0f, 1.0f, 3); } },
+        { "diamond", [](GeometryGenerator& g) { return g.CreateDiamond(1.0f, 1.0f, 1.0f, 3); } },
+        { "tri prism", [](GeometryGenerator& g) { return g.CreateTriangularPrism(1.0f, 1.0f, 1.0f, 3); } },
+        { "pent prism", [](GeometryGenerator& g) { return g.CreatePentagonalPrism(1.0f, 1.0f, 1.0f, 3); } },
+        { "geosphere", [](GeometryGenerator& g) { return g.CreateGeosphere(1.0f, 5); } },
+        { "big sphere", [](GeometryGenerator& g) { return g.CreateSphere(250.0f, 256, 256); } },
+        { "big grid", [](GeometryGenerator& g) { return g.CreateGrid(1000.0f, 10.0f, 512, 64); } },
+        { "quad", [](GeometryGenerator& g) { return g.CreateQuad(100.0f, 50.0f, 20.0f, 10.0f, 3.0f); } },
+    };
+
+    std::printf("PackedVertexLayout round trip, largest error over each mesh as a fraction of its bound\n\n");
+    std::printf("  shape        vertices  position   normal  texcoord   normal deg   result\n");
+
+    bool ok = true;
+    for(const Shape& shape : shapes)
+    {
+        GeometryGenerator::MeshData mesh = shape.Create(geoGen);
+
+        VertexFormat::ConvertContext context;
+        BoundingBox::CreateFromPoints(context.Bounds, mesh.Vertices.size(),
+                                      &mesh.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+
+        std::vector<PackedVertex> packed(mesh.Vertices.size());
+        PackedVertexLayout::Convert(&mesh.Vertices[0], &packed[0], mesh.Vertices.size(), context);
+
+        bool verified = PackedVertexLayout::Verify(&mesh.Vertices[0], &packed[0], mesh.Vertices.size(), context);
+        Errors errors = Measure(mesh, context, packed);
+        float normalFraction = errors.NormalRadians / (3.0f*std::sqrt(2.0f) / 65534.0f);
+        ok &= verified && errors.Failures == 0;
+
+        std::printf("  %-10s %10zu %9.3f %8.3f %9.3f %12.5f   ", shape.Name, mesh.Vertices.size(),
+            errors.Position, normalFraction, errors.TexC, XMConvertToDegrees(errors.NormalRadians));
+        if(!verified)
+            std::printf("FAILED: Verify\n");
+        else if(errors.Failures != 0)
+            std::printf("FAILED: %d vertices out of bounds\n", errors.Failures);
+        else
+            std::printf("ok\n");
+    }
+
+    return ok ? 0 : 1;
+}
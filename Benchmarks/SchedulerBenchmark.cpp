@@ -0,0 +1,77 @@
+//***************************************************************************************
+// SchedulerBenchmark.cpp
+//
+// Scaling of Waves::Update with the number of task scheduler threads, from one thread
+// up to one per hardware thread, doubling in between.  Rows past the hardware thread
+// count only show the cost of oversubscription, so scaling claims need a machine
+// with at least as many cores as the largest count asked for.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Common/TaskScheduler.h"
+#include "../lab assignment 1/Waves.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const float SpatialStep = 1.0f;
+    const float TimeStep = 0.03f;
+    const float Speed = 4.0f;
+    const float Damping = 0.2f;
+
+    double MillisecondsPerStep(int size, int threadCount, int iterations)
+    {
+        TaskScheduler scheduler(threadCount);
+
+        // Keep every tile awake so each step does the same work.
+        Waves waves(size, size, SpatialStep, TimeStep, Speed, Damping, &scheduler);
+        waves.SetMaxSubsteps(1);
+        waves.SetSleepThreshold(0.0f);
+        for(int i = 4; i < size - 1; i += 8)
+        {
+            for(int j = 4; j < size - 1; j += 8)
+                waves.Disturb(i, j, ((i + j) & 1) ? 0.5f : -0.5f);
+        }
+        waves.Update(TimeStep);
+
+        return MillisecondsPerCall(iterations, 5, [&waves]() { waves.Update(TimeStep); });
+    }
+}
+
+int RunSchedulerBenchmark(int argc, char* argv[])
+{
+    int hardwareThreads = (int)std::thread::hardware_concurrency();
+    int size = IntOption(argc, argv, "--size", 2048);
+    int maxThreads = IntOption(argc, argv, "--max-threads", std::max(1, hardwareThreads));
+    int iterations = IterationsForCells(size*size);
+
+    std::vector<int> threadCounts;
+    for(int t = 1; t < maxThreads; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(maxThreads);
+
+    std::printf("Waves step on a %d^2 grid against task scheduler threads\n", size);
+    if(hardwareThreads > 0 && maxThreads > hardwareThreads)
+    {
+        std::printf("Only %d hardware thread%s: rows above that measure oversubscription, not scaling\n",
+            hardwareThreads, hardwareThreads == 1 ? "" : "s");
+    }
+    std::printf("\n");
+    std::printf("  threads    ms/step   speedup   efficiency\n");
+
+    double serialMs = 0.0;
+    for(int threads : threadCounts)
+    {
+        double ms = MillisecondsPerStep(size, threads, iterations);
+        if(threads == 1)
+            serialMs = ms;
+
+        double speedup = serialMs / ms;
+        std::printf("%9d %10.3f %8.2fx %11.0f%%\n", threads, ms, speedup, 100.0*speedup/threads);
+    }
+
+    return 0;
+}
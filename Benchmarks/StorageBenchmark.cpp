@@ -0,0 +1,134 @@
+//***************************************************************************************
+// StorageBenchmark.cpp
+//
+// Memory, step time and accuracy of each Waves::Storage mode.  Every grid is seeded
+// the same and gets the same disturbances, so the compact modes can be compared
+// vertex by vertex with the Float32 run.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Common/TaskScheduler.h"
+#include "../lab assignment 1/Waves.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    // The app's wave constants.
+    const float SpatialStep = 1.0f;
+    const float TimeStep = 0.03f;
+    const float Speed = 4.0f;
+    const float Damping = 0.2f;
+
+    // A few splats of random size land every step.  Their strength keeps the
+    // heights well inside the default Fixed16 range of [-4, 4], which they would
+    // otherwise saturate at.
+    const int ImpulsesPerStep = 4;
+    const float MaxImpulse = 0.1f;
+
+    std::unique_ptr<Waves> SimulateStorage(int size, int steps, Waves::Storage storage, TaskScheduler* scheduler)
+    {
+        std::unique_ptr<Waves> waves(new Waves(size, size, SpatialStep, TimeStep, Speed, Damping,
+            scheduler, Waves::Solver::Explicit, storage));
+        waves->SetMaxSubsteps(1);
+        waves->SetSleepThreshold(0.0f);
+        waves->SeedRandom(1);
+
+        for(int k = 0; k < steps; ++k)
+        {
+            Waves::Impulse impulses[ImpulsesPerStep];
+            for(Waves::Impulse& impulse : impulses)
+            {
+                impulse.Row = waves->RandomInt(1, size - 2);
+                impulse.Col = waves->RandomInt(1, size - 2);
+                impulse.Magnitude = waves->RandomFloat(-MaxImpulse, MaxImpulse);
+                impulse.Radius = waves->RandomFloat(0.0f, 6.0f);
+            }
+            waves->DisturbBatch(impulses, ImpulsesPerStep);
+            waves->Update(TimeStep);
+        }
+
+        return waves;
+    }
+
+    const char* StorageName(Waves::Storage storage)
+    {
+        switch(storage)
+        {
+        case Waves::Storage::Half16: return "Half16";
+        case Waves::Storage::Fixed16: return "Fixed16";
+        default: return "Float32";
+        }
+    }
+}
+
+int RunStorageBenchmark(int argc, char* argv[])
+{
+    TaskScheduler scheduler(IntOption(argc, argv, "--threads", 0));
+    int size = IntOption(argc, argv, "--size", 513);
+    int steps = IntOption(argc, argv, "--steps", 600);
+
+    int threads = scheduler.ThreadCount();
+    std::printf("Waves storage modes on a %d^2 grid after %d disturbed steps, %d thread%s\n\n",
+        size, steps, threads, threads == 1 ? "" : "s");
+    std::printf("  storage   footprint MB   ms/step   height error max / rms   normal error max / rms (deg)\n");
+
+    // Float32 runs first; its heights and normals are kept before it is timed,
+    // since timing steps it further.
+    std::vector<float> referenceHeights;
+    std::vector<XMFLOAT3> referenceNormals;
+    float peak = 0.0f;
+
+    for(Waves::Storage storage : { Waves::Storage::Float32, Waves::Storage::Half16, Waves::Storage::Fixed16 })
+    {
+        std::unique_ptr<Waves> waves = SimulateStorage(size, steps, storage, &scheduler);
+        int count = waves->VertexCount();
+
+        bool isReference = referenceHeights.empty();
+        double maxHeight = 0.0, sumHeight = 0.0;
+        double maxAngle = 0.0, sumAngle = 0.0;
+        for(int i = 0; i < count; ++i)
+        {
+            float h = waves->Position(i).y;
+            XMFLOAT3 n = waves->Normal(i);
+            if(isReference)
+            {
+                referenceHeights.push_back(h);
+                peak = std::max(peak, std::fabs(h));
+                referenceNormals.push_back(n);
+                continue;
+            }
+
+            double dh = std::fabs((double)h - referenceHeights[i]);
+            maxHeight = std::max(maxHeight, dh);
+            sumHeight += dh*dh;
+
+            const XMFLOAT3& r = referenceNormals[i];
+            double cosAngle = std::min(1.0, (double)n.x*r.x + (double)n.y*r.y + (double)n.z*r.z);
+            double angle = std::acos(cosAngle)*180.0/3.14159265358979;
+            maxAngle = std::max(maxAngle, angle);
+            sumAngle += angle*angle;
+        }
+
+        double ms = MillisecondsPerCall(IterationsForCells(size*size) + 4, 5, [&waves]() { waves->Update(TimeStep); });
+        double megabytes = waves->MemoryFootprint() / (1024.0*1024.0);
+
+        if(isReference)
+        {
+            std::printf("  %-8s %13.1f %9.3f   %22s   %28s\n", StorageName(storage), megabytes, ms, "reference", "reference");
+            continue;
+        }
+
+        std::printf("  %-8s %13.1f %9.3f   %11.5f / %8.5f   %17.3f / %8.3f\n", StorageName(storage), megabytes, ms,
+            maxHeight, std::sqrt(sumHeight / count), maxAngle, std::sqrt(sumAngle / count));
+    }
+
+    std::printf("\nLargest Float32 |height| %.3f\n", peak);
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+//***************************************************************************************
+// SubdivisionTest.cpp
+//
+// Headless check of GeometryGenerator::Subdivide on closed meshes.  The geosphere (a
+// subdivided icosahedron) and the box are generated at every subdivision level, on
+// the calling thread and on a task scheduler, and each must stay a closed surface of
+// genus zero: V - E + F == 2 with every edge shared by exactly two triangles.  Vertex
+// counts must match the closed forms 10*4^N + 2 and 6*4^N + 2.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Common/GeometryGenerator.h"
+#include "../Common/TaskScheduler.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    typedef GeometryGenerator::uint32 uint32;
+
+    // Face vertices of the box are not shared, since their normals differ; its
+    // topology is that of the vertices welded by exact position.  Midpoints of the
+    // same edge come out bit for bit the same on both faces.
+    std::vector<uint32> WeldByPosition(const GeometryGenerator::MeshData& mesh, std::size_t& vertexCount)
+    {
+        std::map<std::tuple<float, float, float>, uint32> welded;
+        std::vector<uint32> remap(mesh.Vertices.size());
+        for(std::size_t i = 0; i < mesh.Vertices.size(); ++i)
+        {
+            const DirectX::XMFLOAT3& p = mesh.Vertices[i].Position;
+            remap[i] = welded.insert(std::make_pair(std::make_tuple(p.x, p.y, p.z), (uint32)welded.size())).first->second;
+        }
+
+        vertexCount = welded.size();
+
+        std::vector<uint32> indices(mesh.Indices32.size());
+        for(std::size_t k = 0; k < indices.size(); ++k)
+            indices[k] = remap[mesh.Indices32[k]];
+        return indices;
+    }
+
+    bool CheckClosed(const char* name, uint32 level, std::size_t vertexCount, const std::vector<uint32>& indices,
+                     std::size_t expectedVertices)
+    {
+        std::unordered_map<std::uint64_t, int> edgeUses;
+        for(std::size_t t = 0; t < indices.size(); t += 3)
+        {
+            for(int e = 0; e < 3; ++e)
+            {
+                uint32 a = indices[t + e];
+                uint32 b = indices[t + (e + 1) % 3];
+                ++edgeUses[(std::uint64_t)std::min(a, b) << 32 | std::max(a, b)];
+            }
+        }
+
+        long long v = (long long)vertexCount;
+        long long e = (long long)edgeUses.size();
+        long long f = (long long)indices.size() / 3;
+        std::size_t openEdges = std::count_if(edgeUses.begin(), edgeUses.end(),
+            [](const std::pair<const std::uint64_t, int>& edge) { return edge.second != 2; });
+
+        bool ok = v - e + f == 2 && openEdges == 0 && vertexCount == expectedVertices;
+        std::printf("  %-9s %5u %9lld %9lld %9lld %9lld %10zu   %s\n", name, level, v, e, f, v - e + f, openEdges,
+            ok ? "ok" : vertexCount != expectedVertices ? "FAILED: vertex count" : "FAILED");
+        return ok;
+    }
+}
+
+int RunSubdivisionTest(int argc, char* argv[])
+{
+    // More than one thread, or the scheduler path is never taken.
+    TaskScheduler scheduler(IntOption(argc, argv, "--threads", 4));
+
+    GeometryGenerator serial;
+    GeometryGenerator parallel(&scheduler);
+
+    std::printf("GeometryGenerator::Subdivide, serial and on %d threads\n\n", scheduler.ThreadCount());
+    std::printf("  mesh      level         V         E         F   V-E+F   not 2-shared\n");
+
+    bool ok = true;
+    for(uint32 level = 0; level <= 6; ++level)
+    {
+        std::size_t pow4 = (std::size_t)1 << (2*level);
+
+        GeometryGenerator::MeshData sphere = serial.CreateGeosphere(1.0f, level);
+        GeometryGenerator::MeshData parallelSphere = parallel.CreateGeosphere(1.0f, level);
+        ok &= CheckClosed("geosphere", level, sphere.Vertices.size(), sphere.Indices32, 10*pow4 + 2);
+
+        GeometryGenerator::MeshData box = serial.CreateBox(1.0f, 1.0f, 1.0f, level);
+        GeometryGenerator::MeshData parallelBox = parallel.CreateBox(1.0f, 1.0f, 1.0f, level);
+        std::size_t boxVertices = 0;
+        std::vector<uint32> boxIndices = WeldByPosition(box, boxVertices);
+        ok &= CheckClosed("box", level, boxVertices, boxIndices, 6*pow4 + 2);
+
+        // The scheduler may only change how fast the result comes out.
+        if(parallelSphere.Indices32 != sphere.Indices32 || parallelSphere.Vertices.size() != sphere.Vertices.size() ||
+           parallelBox.Indices32 != box.Indices32 || parallelBox.Vertices.size() != box.Vertices.size())
+        {
+            std::printf("  level %u: the parallel subdivision differs from the serial one\n", level);
+            ok = false;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+//***************************************************************************************
+// WaterSimThreadTest.cpp
+//
+// Headless check that WaterSimThread never hands the render thread a torn frame.  The
+// surface under test stamps every vertex with the total time it has been advanced,
+// and every submitted step is one second, so a frame is intact exactly when all of
+// its vertices carry its own sequence number.  The render side reads every frame in
+// full, while the worker keeps writing the other slots.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../lab assignment 1/WaterSimThread.h"
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+using namespace DirectX;
+
+namespace
+{
+    class StampSurface final : public WaterSurface
+    {
+    public:
+        explicit StampSurface(int n) : mNumPoints(n) {}
+
+        int RowCount()const override { return mNumPoints; }
+        int ColumnCount()const override { return mNumPoints; }
+        int VertexCount()const override { return mNumPoints*mNumPoints; }
+        int TriangleCount()const override { return 2*(mNumPoints - 1)*(mNumPoints - 1); }
+        float Width()const override { return (float)mNumPoints; }
+        float Depth()const override { return (float)mNumPoints; }
+        float SpatialStep()const override { return 1.0f; }
+
+        XMFLOAT3 Position(int i)const override { return XMFLOAT3((float)(i % mNumPoints), mTime, (float)(i / mNumPoints)); }
+        XMFLOAT3 Normal(int)const override { return XMFLOAT3(0.0f, 1.0f, 0.0f); }
+        XMFLOAT3 TangentX(int)const override { return XMFLOAT3(1.0f, 0.0f, 0.0f); }
+
+        void Update(float dt) override { mTime += dt; }
+
+        void WriteVertices(Vertex* dest)const override
+        {
+            for(int i = 0; i < VertexCount(); ++i)
+                dest[i] = { Position(i), Normal(i), XMFLOAT2(0.0f, 0.0f) };
+        }
+
+        void WriteStaticVertices(StaticVertex* dest)const override
+        {
+            for(int i = 0; i < VertexCount(); ++i)
+                dest[i] = { XMFLOAT2(Position(i).x, Position(i).z), XMFLOAT2(0.0f, 0.0f) };
+        }
+
+        void WriteStreamVertices(StreamVertex* dest)const override
+        {
+            for(int i = 0; i < VertexCount(); ++i)
+                StoreStreamVertex(dest + i, mTime, XMFLOAT3(0.0f, 1.0f, 0.0f));
+        }
+
+    private:
+        int mNumPoints = 0;
+        float mTime = 0.0f;
+    };
+
+    bool IsIntact(const WaterSimThread::Frame& frame)
+    {
+        float stamp = (float)frame.Sequence;
+        if(frame.EndSequence != frame.Sequence || frame.Time != stamp)
+            return false;
+
+        for(const WaterSurface::StreamVertex& v : frame.Vertices)
+        {
+            if(v.Height != stamp)
+                return false;
+        }
+
+        return true;
+    }
+}
+
+int RunWaterSimThreadTest(int argc, char* argv[])
+{
+    // Frames big enough that writing one takes a couple of milliseconds, so the
+    // worker can be caught mid-write even when both threads share a core.
+    int size = IntOption(argc, argv, "--size", 1024);
+    int frames = IntOption(argc, argv, "--frames", 3000);
+
+    StampSurface surface(size);
+    WaterSimThread sim(&surface, [&surface](float dt) { surface.Update(dt); });
+
+    std::uint64_t submitted = 0;
+    std::uint64_t lastSequence = 0;
+    std::uint64_t distinct = 0;
+    int torn = 0;
+
+    for(int k = 0; k < frames; ++k)
+    {
+        // Vary the pace so the render side sometimes outruns the worker, sometimes
+        // falls behind it, and sometimes reads the same frame again.
+        if(k % 3 != 2)
+        {
+            sim.Submit(1.0f);
+            ++submitted;
+        }
+        if(k % 7 == 0)
+            std::this_thread::yield();
+
+        const WaterSimThread::Frame& frame = sim.Latest();
+        if(!IsIntact(frame))
+        {
+            if(torn++ < 10)
+                std::printf("torn frame: sequence %llu\n", (unsigned long long)frame.Sequence);
+        }
+        if(frame.Sequence < lastSequence)
+        {
+            std::printf("frame went back from sequence %llu to %llu\n",
+                (unsigned long long)lastSequence, (unsigned long long)frame.Sequence);
+            return 1;
+        }
+
+        distinct += frame.Sequence != lastSequence;
+        lastSequence = frame.Sequence;
+    }
+
+    // Everything submitted must show up once the worker has caught up.
+    sim.Flush();
+    const WaterSimThread::Frame& last = sim.Latest();
+    bool complete = last.Sequence == submitted && IsIntact(last);
+
+    std::printf("%d reads of %d^2 vertex frames, %llu distinct frames, %d torn, last frame %s\n",
+        frames, size, (unsigned long long)distinct, torn, complete ? "complete" : "missing updates");
+
+    return torn == 0 && complete ? 0 : 1;
+}
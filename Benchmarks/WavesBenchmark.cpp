@@ -0,0 +1,294 @@
+//***************************************************************************************
+// WavesBenchmark.cpp
+//
+// Time per simulation step of Waves::Update, which steps the heights and computes the
+// normals of each tile in one sweep, against the update Waves had before: one full
+// sweep over the grid for the heights and a second one for normals and tangents.
+//
+// That compares the change of layout and the fusion together, so the height stencil
+// is also timed on its own: the original sweep over XMFLOAT3 solutions against the
+// same sweep over aligned float planes with Simd ops, as Waves steps a row.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Common/AlignedAllocator.h"
+#include "../Common/TaskScheduler.h"
+#include "../lab assignment 1/SimdFloat.h"
+#include "../lab assignment 1/Waves.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    // The app's wave constants.
+    const float SpatialStep = 1.0f;
+    const float TimeStep = 0.03f;
+    const float Speed = 4.0f;
+    const float Damping = 0.2f;
+
+    // Disturbances are spread this many cells apart so the whole grid is moving.
+    const int DisturbSpacing = 8;
+
+    // The original two-pass update, with concurrency::parallel_for replaced by the
+    // task scheduler so both updates run on the same threads.  Solutions, normals
+    // and tangents are XMFLOAT3 arrays with x and z filled in, as they were.
+    class TwoPassWaves
+    {
+    public:
+        TwoPassWaves(int m, int n, float dx, float dt, float speed, float damping, TaskScheduler* scheduler)
+        {
+            mScheduler = scheduler;
+            mNumRows = m;
+            mNumCols = n;
+            mSpatialStep = dx;
+
+            float d = damping*dt + 2.0f;
+            float e = (speed*speed)*(dt*dt) / (dx*dx);
+            mK1 = (damping*dt - 2.0f) / d;
+            mK2 = (4.0f - 8.0f*e) / d;
+            mK3 = (2.0f*e) / d;
+
+            mPrevSolution.resize(m*n);
+            mCurrSolution.resize(m*n);
+            mNormals.assign(m*n, XMFLOAT3(0.0f, 1.0f, 0.0f));
+            mTangentX.assign(m*n, XMFLOAT3(1.0f, 0.0f, 0.0f));
+
+            float halfWidth = (n - 1)*dx*0.5f;
+            float halfDepth = (m - 1)*dx*0.5f;
+            for(int i = 0; i < m; ++i)
+            {
+                for(int j = 0; j < n; ++j)
+                {
+                    XMFLOAT3 p(-halfWidth + j*dx, 0.0f, halfDepth - i*dx);
+                    mPrevSolution[i*n + j] = p;
+                    mCurrSolution[i*n + j] = p;
+                }
+            }
+        }
+
+        void Disturb(int i, int j, float magnitude)
+        {
+            float halfMag = 0.5f*magnitude;
+
+            mCurrSolution[i*mNumCols + j].y += magnitude;
+            mCurrSolution[i*mNumCols + j + 1].y += halfMag;
+            mCurrSolution[i*mNumCols + j - 1].y += halfMag;
+            mCurrSolution[(i + 1)*mNumCols + j].y += halfMag;
+            mCurrSolution[(i - 1)*mNumCols + j].y += halfMag;
+        }
+
+        void Step()
+        {
+            StepHeights();
+            ComputeNormals();
+        }
+
+        void StepHeights()
+        {
+            int n = mNumCols;
+
+            ParallelFor(mScheduler, 1, mNumRows - 1, 1, [this, n](int i)
+            {
+                for(int j = 1; j < n - 1; ++j)
+                {
+                    mPrevSolution[i*n + j].y =
+                        mK1*mPrevSolution[i*n + j].y +
+                        mK2*mCurrSolution[i*n + j].y +
+                        mK3*(mCurrSolution[(i + 1)*n + j].y +
+                             mCurrSolution[(i - 1)*n + j].y +
+                             mCurrSolution[i*n + j + 1].y +
+                             mCurrSolution[i*n + j - 1].y);
+                }
+            });
+
+            std::swap(mPrevSolution, mCurrSolution);
+        }
+
+        void ComputeNormals()
+        {
+            int n = mNumCols;
+
+            ParallelFor(mScheduler, 1, mNumRows - 1, 1, [this, n](int i)
+            {
+                for(int j = 1; j < n - 1; ++j)
+                {
+                    float l = mCurrSolution[i*n + j - 1].y;
+                    float r = mCurrSolution[i*n + j + 1].y;
+                    float t = mCurrSolution[(i - 1)*n + j].y;
+                    float b = mCurrSolution[(i + 1)*n + j].y;
+
+                    mNormals[i*n + j] = XMFLOAT3(-r + l, 2.0f*mSpatialStep, b - t);
+                    XMStoreFloat3(&mNormals[i*n + j], XMVector3Normalize(XMLoadFloat3(&mNormals[i*n + j])));
+
+                    mTangentX[i*n + j] = XMFLOAT3(2.0f*mSpatialStep, r - l, 0.0f);
+                    XMStoreFloat3(&mTangentX[i*n + j], XMVector3Normalize(XMLoadFloat3(&mTangentX[i*n + j])));
+                }
+            });
+        }
+
+    private:
+        TaskScheduler* mScheduler = nullptr;
+        int mNumRows = 0;
+        int mNumCols = 0;
+        float mSpatialStep = 0.0f;
+        float mK1 = 0.0f;
+        float mK2 = 0.0f;
+        float mK3 = 0.0f;
+
+        std::vector<XMFLOAT3> mPrevSolution;
+        std::vector<XMFLOAT3> mCurrSolution;
+        std::vector<XMFLOAT3> mNormals;
+        std::vector<XMFLOAT3> mTangentX;
+    };
+
+    // The height stencil of Waves with Float32 storage and no obstacles or sponge:
+    // each row is run in whole SIMD blocks across the padded row, whose edge and
+    // padding lanes are cleared again afterwards.
+    class SoaStencil
+    {
+    public:
+        SoaStencil(int m, int n, float dx, float dt, float speed, float damping, TaskScheduler* scheduler)
+        {
+            mScheduler = scheduler;
+            mNumRows = m;
+            mNumCols = n;
+            mRowPitch = Simd::RoundUp(n);
+
+            float d = damping*dt + 2.0f;
+            float e = (speed*speed)*(dt*dt) / (dx*dx);
+            mK1 = (damping*dt - 2.0f) / d;
+            mK2 = (4.0f - 8.0f*e) / d;
+            mK3 = (2.0f*e) / d;
+
+            mPrevSolution.assign(m*mRowPitch, 0.0f);
+            mCurrSolution.assign(m*mRowPitch, 0.0f);
+        }
+
+        void Disturb(int i, int j, float magnitude)
+        {
+            float halfMag = 0.5f*magnitude;
+
+            mCurrSolution[i*mRowPitch + j] += magnitude;
+            mCurrSolution[i*mRowPitch + j + 1] += halfMag;
+            mCurrSolution[i*mRowPitch + j - 1] += halfMag;
+            mCurrSolution[(i + 1)*mRowPitch + j] += halfMag;
+            mCurrSolution[(i - 1)*mRowPitch + j] += halfMag;
+        }
+
+        void StepHeights()
+        {
+            ParallelFor(mScheduler, 1, mNumRows - 1, 1, [this](int i)
+            {
+                const float* up = &mCurrSolution[(i - 1)*mRowPitch];
+                const float* curr = &mCurrSolution[i*mRowPitch];
+                const float* down = &mCurrSolution[(i + 1)*mRowPitch];
+                float* prev = &mPrevSolution[i*mRowPitch];
+
+                const Simd::Float k1 = Simd::Set1(mK1);
+                const Simd::Float k2 = Simd::Set1(mK2);
+                const Simd::Float k3 = Simd::Set1(mK3);
+
+                for(int j = 0; j < mRowPitch; j += Simd::Width)
+                {
+                    Simd::Float c = Simd::Load(curr + j);
+                    Simd::Float sum = Simd::Add(Simd::Add(Simd::Add(
+                        Simd::Load(down + j), Simd::Load(up + j)),
+                        Simd::LoadU(curr + j + 1)), Simd::LoadU(curr + j - 1));
+
+                    Simd::Store(prev + j, Simd::Add(Simd::Add(
+                        Simd::Mul(k1, Simd::Load(prev + j)),
+                        Simd::Mul(k2, c)),
+                        Simd::Mul(k3, sum)));
+                }
+
+                prev[0] = 0.0f;
+                for(int j = mNumCols - 1; j < mRowPitch; ++j)
+                    prev[j] = 0.0f;
+            });
+
+            std::swap(mPrevSolution, mCurrSolution);
+        }
+
+    private:
+        typedef std::vector<float, AlignedAllocator<float, Simd::Alignment>> HeightPlane;
+
+        TaskScheduler* mScheduler = nullptr;
+        int mNumRows = 0;
+        int mNumCols = 0;
+        int mRowPitch = 0;
+        float mK1 = 0.0f;
+        float mK2 = 0.0f;
+        float mK3 = 0.0f;
+
+        HeightPlane mPrevSolution;
+        HeightPlane mCurrSolution;
+    };
+
+    template<class Grid>
+    void DisturbEverywhere(Grid& grid, int m, int n)
+    {
+        for(int i = DisturbSpacing/2; i < m - 1; i += DisturbSpacing)
+        {
+            for(int j = DisturbSpacing/2; j < n - 1; j += DisturbSpacing)
+                grid.Disturb(i, j, ((i + j) & 1) ? 0.5f : -0.5f);
+        }
+    }
+}
+
+int RunWavesBenchmark(int argc, char* argv[])
+{
+    TaskScheduler scheduler(IntOption(argc, argv, "--threads", 0));
+
+    int threads = scheduler.ThreadCount();
+    std::printf("Waves step, original two passes against fused tiles, %d thread%s\n\n", threads, threads == 1 ? "" : "s");
+    std::printf("     grid   two-pass ms    fused ms   speedup\n");
+
+    for(int size : { 128, 512, 2048 })
+    {
+        int iterations = IterationsForCells(size*size);
+
+        TwoPassWaves twoPass(size, size, SpatialStep, TimeStep, Speed, Damping, &scheduler);
+        DisturbEverywhere(twoPass, size, size);
+        double twoPassMs = MillisecondsPerCall(iterations, 5, [&twoPass]() { twoPass.Step(); });
+
+        // No tile may fall asleep, or the fused update would skip work the two-pass
+        // one does.
+        Waves waves(size, size, SpatialStep, TimeStep, Speed, Damping, &scheduler);
+        waves.SetMaxSubsteps(1);
+        waves.SetSleepThreshold(0.0f);
+        DisturbEverywhere(waves, size, size);
+        waves.Update(TimeStep);
+        double fusedMs = MillisecondsPerCall(iterations, 5, [&waves]() { waves.Update(TimeStep); });
+
+        if(waves.ActiveTileCount() != waves.TileCount())
+        {
+            std::printf("%5d^2: only %d of %d tiles were stepped\n", size, waves.ActiveTileCount(), waves.TileCount());
+            return 1;
+        }
+
+        std::printf("%7d^2 %13.3f %11.3f %8.2fx\n", size, twoPassMs, fusedMs, twoPassMs / fusedMs);
+    }
+
+    std::printf("\nHeight stencil only, XMFLOAT3 solutions against SoA planes with %d-wide SIMD\n\n", Simd::Width);
+    std::printf("     grid        AoS ms      SoA ms   speedup\n");
+
+    for(int size : { 128, 512, 2048 })
+    {
+        int iterations = IterationsForCells(size*size);
+
+        TwoPassWaves aos(size, size, SpatialStep, TimeStep, Speed, Damping, &scheduler);
+        DisturbEverywhere(aos, size, size);
+        double aosMs = MillisecondsPerCall(iterations, 5, [&aos]() { aos.StepHeights(); });
+
+        SoaStencil soa(size, size, SpatialStep, TimeStep, Speed, Damping, &scheduler);
+        DisturbEverywhere(soa, size, size);
+        double soaMs = MillisecondsPerCall(iterations, 5, [&soa]() { soa.StepHeights(); });
+
+        std::printf("%7d^2 %13.3f %11.3f %8.2fx\n", size, aosMs, soaMs, aosMs / soaMs);
+    }
+
+    return 0;
+}
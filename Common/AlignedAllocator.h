@@ -0,0 +1,65 @@
+//***************************************************************************************
+// AlignedAllocator.h
+//
+// Minimal std::allocator replacement that returns memory aligned to a fixed
+// boundary.  Used for float planes that are streamed through SSE/AVX registers
+// with aligned loads and stores.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+template<typename T, std::size_t Alignment>
+class AlignedAllocator
+{
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t count)
+    {
+        if(count == 0)
+            return nullptr;
+
+        void* p = nullptr;
+#if defined(_MSC_VER)
+        p = _aligned_malloc(count*sizeof(T), Alignment);
+#else
+        if(posix_memalign(&p, Alignment, count*sizeof(T)) != 0)
+            p = nullptr;
+#endif
+        if(p == nullptr)
+            throw std::bad_alloc();
+
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+#if defined(_MSC_VER)
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&)const { return true; }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&)const { return false; }
+};
@@ -3,10 +3,342 @@
 //***************************************************************************************
 
 #include "GeometryGenerator.h"
+#include "TaskScheduler.h"
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <xmmintrin.h>
 
 using namespace DirectX;
 
+namespace
+{
+	using uint32 = GeometryGenerator::uint32;
+
+	// No edge joins a vertex to itself with both indices all ones.
+	const std::uint64_t EmptyEdgeKey = ~0ull;
+
+	// Meshes with fewer triangles than this are subdivided on the calling thread;
+	// the parallel path makes four passes over the triangles and only pays off once
+	// there are a few chunks for every thread.
+	const uint32 SubdivideChunkTriangles = 4096;
+	const uint32 ParallelSubdivideMinTriangles = 4*SubdivideChunkTriangles;
+
+	// An edge, its two vertex indices in either order, as one key.
+	std::uint64_t EdgeKey(uint32 a, uint32 b)
+	{
+		return a < b ? ((std::uint64_t)a << 32) | b : ((std::uint64_t)b << 32) | a;
+	}
+
+	std::size_t EdgeHash(std::uint64_t key)
+	{
+		return (std::size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+
+	// Smallest power of two table with at most half its slots used by maxEdges.
+	std::size_t EdgeTableCapacity(std::size_t maxEdges)
+	{
+		std::size_t capacity = 16;
+		while(capacity < 2*maxEdges)
+			capacity *= 2;
+		return capacity;
+	}
+
+	// Corners of edge e of a triangle: (v0, v1), (v1, v2) and (v0, v2), the order
+	// the midpoints m0, m1 and m2 are numbered in.
+	const int EdgeCorners[3][2] = { { 0, 1 }, { 1, 2 }, { 0, 2 } };
+
+	// Open addressing hash from an edge to the index of its midpoint vertex.  Sized
+	// up front for a given number of edges and never grown.
+	class EdgeMidpointCache
+	{
+	public:
+		// Empties the table, reusing its memory when it is already big enough.
+		void Reset(std::size_t maxEdges)
+		{
+			std::size_t capacity = std::max(EdgeTableCapacity(maxEdges), mSlots.size());
+			mSlots.assign(capacity, Slot());
+			mMask = capacity - 1;
+		}
+
+		// Index of the midpoint of edge (a, b), appending midPoint(vertices[a],
+		// vertices[b]) to vertices the first time.
+		template<class MidPointFunc>
+		std::uint32_t FindOrAdd(std::uint32_t a, std::uint32_t b,
+			std::vector<GeometryGenerator::Vertex>& vertices, const MidPointFunc& midPoint)
+		{
+			std::uint64_t key = EdgeKey(a, b);
+
+			std::size_t slot = EdgeHash(key) & mMask;
+			for(;;)
+			{
+				Slot& s = mSlots[slot];
+				if(s.Key == key)
+					return s.Midpoint;
+
+				if(s.Key == EmptyEdgeKey)
+				{
+					s.Key = key;
+					s.Midpoint = (std::uint32_t)vertices.size();
+					vertices.push_back(midPoint(vertices[a], vertices[b]));
+					return s.Midpoint;
+				}
+
+				slot = (slot + 1) & mMask;
+			}
+		}
+
+	private:
+		struct Slot
+		{
+			std::uint64_t Key = EmptyEdgeKey;
+			std::uint32_t Midpoint = 0;
+		};
+
+		std::vector<Slot> mSlots;
+		std::size_t mMask = 0;
+	};
+
+	// The same table filled from several threads at once.  Keys are claimed with a
+	// compare-exchange, and every edge keeps the lowest id, 3*triangle + edge, of
+	// the triangle edges that share it.  That edge owns the midpoint, so numbering
+	// the owners in id order gives the midpoints exactly the indices the serial
+	// first-come numbering does.
+	class ConcurrentEdgeTable
+	{
+	public:
+		struct Slot
+		{
+			std::atomic<std::uint64_t> Key;
+			std::atomic<std::uint32_t> Owner;
+			std::uint32_t Midpoint;
+		};
+
+		void Reset(TaskScheduler* scheduler, std::size_t maxEdges)
+		{
+			std::size_t capacity = std::max(EdgeTableCapacity(maxEdges), mCapacity);
+			if(capacity != mCapacity)
+			{
+				mSlots.reset(new Slot[capacity]);
+				mCapacity = capacity;
+			}
+			mMask = capacity - 1;
+
+			const int blockSize = 1 << 16;
+			int numBlocks = (int)((capacity + blockSize - 1) / blockSize);
+			ParallelFor(scheduler, 0, numBlocks, 1, [this, blockSize](int block)
+			{
+				std::size_t end = std::min(mCapacity, (std::size_t)(block + 1)*blockSize);
+				for(std::size_t i = (std::size_t)block*blockSize; i < end; ++i)
+				{
+					mSlots[i].Key.store(EmptyEdgeKey, std::memory_order_relaxed);
+					mSlots[i].Owner.store(~0u, std::memory_order_relaxed);
+				}
+			});
+		}
+
+		// Adds edge (a, b) seen as triangle edge id and returns its slot.
+		std::uint32_t Insert(std::uint32_t a, std::uint32_t b, std::uint32_t id)
+		{
+			std::uint64_t key = EdgeKey(a, b);
+
+			std::size_t slot = EdgeHash(key) & mMask;
+			for(;;)
+			{
+				Slot& s = mSlots[slot];
+
+				std::uint64_t current = s.Key.load(std::memory_order_relaxed);
+				if(current == EmptyEdgeKey && s.Key.compare_exchange_strong(current, key, std::memory_order_relaxed))
+					current = key;
+
+				if(current == key)
+				{
+					std::uint32_t owner = s.Owner.load(std::memory_order_relaxed);
+					while(id < owner && !s.Owner.compare_exchange_weak(owner, id, std::memory_order_relaxed))
+					{
+					}
+					return (std::uint32_t)slot;
+				}
+
+				slot = (slot + 1) & mMask;
+			}
+		}
+
+		// Only read between passes, once every Insert has returned.
+		Slot& operator[](std::uint32_t slot) { return mSlots[slot]; }
+
+	private:
+		std::unique_ptr<Slot[]> mSlots;
+		std::size_t mCapacity = 0;
+		std::size_t mMask = 0;
+	};
+
+	// Scratch memory kept across the levels of one Subdivide call.
+	struct SubdivideScratch
+	{
+		std::vector<uint32> InputIndices;
+
+		EdgeMidpointCache Midpoints;
+
+		ConcurrentEdgeTable Edges;
+		std::vector<uint32> EdgeSlots;      // table slot of every triangle edge
+		std::vector<uint32> ChunkMidpoints; // midpoints owned by each chunk, then the prefix sum
+	};
+
+	//       v1
+	//       *
+	//      / \
+	//     /   \
+	//  m0*-----*m1
+	//   / \   / \
+	//  /   \ /   \
+	// *-----*-----*
+	// v0    m2     v2
+	void WriteSubdividedTriangle(uint32* k, uint32 v0, uint32 v1, uint32 v2, uint32 m0, uint32 m1, uint32 m2)
+	{
+		k[0] = v0;  k[1]  = m0; k[2]  = m2;
+		k[3] = m0;  k[4]  = m1; k[5]  = m2;
+		k[6] = m2;  k[7]  = m1; k[8]  = v2;
+		k[9] = m0;  k[10] = v1; k[11] = m1;
+	}
+
+	template<class MidPointFunc>
+	void SubdivideSerial(const std::vector<uint32>& inputIndices, GeometryGenerator::MeshData& meshData,
+		EdgeMidpointCache& midpoints, const MidPointFunc& midPoint)
+	{
+		uint32 numTris = (uint32)inputIndices.size()/3;
+		midpoints.Reset(numTris*3);
+
+		uint32* k = meshData.Indices32.data();
+		for(uint32 i = 0; i < numTris; ++i)
+		{
+			uint32 v0 = inputIndices[i*3+0];
+			uint32 v1 = inputIndices[i*3+1];
+			uint32 v2 = inputIndices[i*3+2];
+
+			uint32 m0 = midpoints.FindOrAdd(v0, v1, meshData.Vertices, midPoint);
+			uint32 m1 = midpoints.FindOrAdd(v1, v2, meshData.Vertices, midPoint);
+			uint32 m2 = midpoints.FindOrAdd(v0, v2, meshData.Vertices, midPoint);
+
+			WriteSubdividedTriangle(k, v0, v1, v2, m0, m1, m2);
+			k += 12;
+		}
+	}
+
+	// Splits the triangles into chunks and makes four passes over them: insert
+	// every edge, count the midpoints each chunk owns, write the owned midpoints at
+	// offsets from a prefix sum of the counts, and write the new triangles.  Every
+	// pass writes straight into presized arrays, each chunk to its own range.
+	template<class MidPointFunc>
+	void SubdivideParallel(TaskScheduler* scheduler, GeometryGenerator::MeshData& meshData,
+		SubdivideScratch& scratch, const MidPointFunc& midPoint)
+	{
+		const std::vector<uint32>& inputIndices = scratch.InputIndices;
+		uint32 numTris = (uint32)inputIndices.size()/3;
+		uint32 numEdges = numTris*3;
+		int numChunks = (int)((numTris + SubdivideChunkTriangles - 1) / SubdivideChunkTriangles);
+
+		auto chunkEdges = [numEdges](int chunk, uint32& first, uint32& last)
+		{
+			first = (uint32)chunk*SubdivideChunkTriangles*3;
+			last = std::min(numEdges, first + SubdivideChunkTriangles*3);
+		};
+
+		ConcurrentEdgeTable& edges = scratch.Edges;
+		std::vector<uint32>& edgeSlots = scratch.EdgeSlots;
+		std::vector<uint32>& chunkMidpoints = scratch.ChunkMidpoints;
+
+		edges.Reset(scheduler, numEdges);
+		edgeSlots.resize(numEdges);
+		chunkMidpoints.resize(numChunks);
+
+		ParallelFor(scheduler, 0, numChunks, 1, [&](int chunk)
+		{
+			uint32 first, last;
+			chunkEdges(chunk, first, last);
+
+			for(uint32 e = first; e < last; ++e)
+			{
+				const uint32* tri = &inputIndices[e - e%3];
+				edgeSlots[e] = edges.Insert(tri[EdgeCorners[e%3][0]], tri[EdgeCorners[e%3][1]], e);
+			}
+		});
+
+		ParallelFor(scheduler, 0, numChunks, 1, [&](int chunk)
+		{
+			uint32 first, last;
+			chunkEdges(chunk, first, last);
+
+			uint32 count = 0;
+			for(uint32 e = first; e < last; ++e)
+				count += edges[edgeSlots[e]].Owner.load(std::memory_order_relaxed) == e;
+			chunkMidpoints[chunk] = count;
+		});
+
+		uint32 numVertices = (uint32)meshData.Vertices.size();
+		uint32 numMidpoints = 0;
+		for(uint32& count : chunkMidpoints)
+		{
+			uint32 chunkFirst = numVertices + numMidpoints;
+			numMidpoints += count;
+			count = chunkFirst;
+		}
+		meshData.Vertices.resize(numVertices + numMidpoints);
+
+		GeometryGenerator::Vertex* vertices = meshData.Vertices.data();
+		ParallelFor(scheduler, 0, numChunks, 1, [&](int chunk)
+		{
+			uint32 first, last;
+			chunkEdges(chunk, first, last);
+
+			uint32 next = chunkMidpoints[chunk];
+			for(uint32 e = first; e < last; ++e)
+			{
+				ConcurrentEdgeTable::Slot& s = edges[edgeSlots[e]];
+				if(s.Owner.load(std::memory_order_relaxed) != e)
+					continue;
+
+				const uint32* tri = &inputIndices[e - e%3];
+				s.Midpoint = next;
+				vertices[next++] = midPoint(vertices[tri[EdgeCorners[e%3][0]]], vertices[tri[EdgeCorners[e%3][1]]]);
+			}
+		});
+
+		uint32* indices = meshData.Indices32.data();
+		ParallelFor(scheduler, 0, numChunks, 1, [&](int chunk)
+		{
+			uint32 first, last;
+			chunkEdges(chunk, first, last);
+
+			for(uint32 e = first; e < last; e += 3)
+			{
+				const uint32* tri = &inputIndices[e];
+				WriteSubdividedTriangle(&indices[e*4], tri[0], tri[1], tri[2],
+					edges[edgeSlots[e+0]].Midpoint, edges[edgeSlots[e+1]].Midpoint, edges[edgeSlots[e+2]].Midpoint);
+			}
+		});
+	}
+
+	// Writes a whole vertex assembled in three registers: (Position, Normal.x),
+	// (Normal.yz, TangentU.xy) and (TangentU.z, TexC) in the low three lanes.  Four
+	// stores instead of eleven scalar ones.
+	void StoreVertex(GeometryGenerator::Vertex& v, __m128 a, __m128 b, __m128 c)
+	{
+		static_assert(sizeof(GeometryGenerator::Vertex) == 11*sizeof(float), "Vertex must be 11 packed floats.");
+
+		float* p = reinterpret_cast<float*>(&v);
+		_mm_storeu_ps(p, a);
+		_mm_storeu_ps(p + 4, b);
+		_mm_storel_pi(reinterpret_cast<__m64*>(p + 8), c);
+		_mm_store_ss(p + 10, _mm_movehl_ps(c, c));
+	}
+}
+
+GeometryGenerator::GeometryGenerator(TaskScheduler* scheduler)
+	: mScheduler(scheduler)
+{
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
     MeshData meshData;
@@ -94,8 +426,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
     // Put a cap on the number of subdivisions.
     numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-    for(uint32 i = 0; i < numSubdivisions; ++i)
-        Subdivide(meshData);
+    Subdivide(meshData, numSubdivisions);
 
     return meshData;
 }
@@ -104,6 +435,10 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 {
     MeshData meshData;
 
+	uint32 ringVertexCount = sliceCount + 1;
+	meshData.Vertices.resize((stackCount-1)*ringVertexCount + 2);
+	meshData.Indices32.resize(6*sliceCount*(stackCount-1));
+
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
 	//
@@ -114,47 +449,44 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back( topVertex );
+	meshData.Vertices.front() = topVertex;
+	meshData.Vertices.back() = bottomVertex;
 
 	float phiStep   = XM_PI/stackCount;
 	float thetaStep = 2.0f*XM_PI/sliceCount;
 
+	// Every ring shares the same slice angles.
+	std::vector<XMFLOAT2> slices;
+	BuildSliceTable(sliceCount, slices);
+
 	// Compute vertices for each stack ring (do not count the poles as rings).
+	Vertex* v = &meshData.Vertices[1];
 	for(uint32 i = 1; i <= stackCount-1; ++i)
 	{
 		float phi = i*phiStep;
+		float sinPhi = sinf(phi);
+		float cosPhi = cosf(phi);
+		float texV = phi / XM_PI;
 
 		// Vertices of ring.
         for(uint32 j = 0; j <= sliceCount; ++j)
 		{
-			float theta = j*thetaStep;
-
-			Vertex v;
-
-			// spherical to cartesian
-			v.Position.x = radius*sinf(phi)*cosf(theta);
-			v.Position.y = radius*cosf(phi);
-			v.Position.z = radius*sinf(phi)*sinf(theta);
-
-			// Partial derivative of P with respect to theta
-			v.TangentU.x = -radius*sinf(phi)*sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = +radius*sinf(phi)*cosf(theta);
-
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
-
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
-
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
-
-			meshData.Vertices.push_back( v );
+			float c = slices[j].x;
+			float s = slices[j].y;
+
+			// Spherical to cartesian; the normal is the unit position and the
+			// tangent the normalized partial derivative of P with respect to theta.
+			float nx = sinPhi*c;
+			float nz = sinPhi*s;
+
+			StoreVertex(*v++,
+				_mm_setr_ps(radius*nx, radius*cosPhi, radius*nz, nx),
+				_mm_setr_ps(cosPhi, nz, -s, 0.0f),
+				_mm_setr_ps(c, j*thetaStep / XM_2PI, texV, 0.0f));
 		}
 	}
 
-	meshData.Vertices.push_back( bottomVertex );
+	uint32* k = meshData.Indices32.data();
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
@@ -163,9 +495,9 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 
     for(uint32 i = 1; i <= sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
+		*k++ = 0;
+		*k++ = i+1;
+		*k++ = i;
 	}
 	
 	//
@@ -175,18 +507,19 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	// Offset the indices to the index of the first vertex in the first ring.
 	// This is just skipping the top pole vertex.
     uint32 baseIndex = 1;
-    uint32 ringVertexCount = sliceCount + 1;
 	for(uint32 i = 0; i < stackCount-2; ++i)
 	{
+		uint32 row = baseIndex + i*ringVertexCount;
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+			k[0] = row + j;
+			k[1] = row + j+1;
+			k[2] = row + ringVertexCount + j;
+
+			k[3] = row + ringVertexCount + j;
+			k[4] = row + j+1;
+			k[5] = row + ringVertexCount + j+1;
+			k += 6;
 		}
 	}
 
@@ -203,9 +536,9 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
+		*k++ = southPoleIndex;
+		*k++ = baseIndex+i;
+		*k++ = baseIndex+i+1;
 	}
 
     return meshData;
@@ -213,64 +546,42 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
  
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
-
-
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
-
-	//       v1
-	//       *
-	//      / \
-	//     /   \
-	//  m0*-----*m1
-	//   / \   / \
-	//  /   \ /   \
-	// *-----*-----*
-	// v0    m2     v2
+	Subdivide(meshData, 1);
+}
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
-	for(uint32 i = 0; i < numTris; ++i)
+void GeometryGenerator::Subdivide(MeshData& meshData, uint32 numSubdivisions)
+{
+	if(numSubdivisions == 0)
+		return;
+
+	// The input vertices are kept where they are and each edge gets one midpoint
+	// vertex, appended after them, however many triangles share the edge.  A closed
+	// mesh has 3/2 edges per triangle, so that is what is reserved for every level.
+	std::size_t numVertices = meshData.Vertices.size();
+	std::size_t numTris = meshData.Indices32.size()/3;
+	for(uint32 level = 0; level < numSubdivisions; ++level)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
-
-		//
-		// Generate the midpoints.
-		//
-
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
-
-		//
-		// Add new geometry.
-		//
-
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
-
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+		numVertices += numTris*3/2 + 3;
+		numTris *= 4;
+	}
+	meshData.Vertices.reserve(numVertices);
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+	SubdivideScratch scratch;
+	auto midPoint = [this](const Vertex& a, const Vertex& b) { return MidPoint(a, b); };
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+	for(uint32 level = 0; level < numSubdivisions; ++level)
+	{
+		// The output of one level is the input of the next; the two index buffers
+		// trade places every level.
+		scratch.InputIndices.swap(meshData.Indices32);
+		uint32 levelTris = (uint32)scratch.InputIndices.size()/3;
+		meshData.Indices32.clear();
+		meshData.Indices32.resize(levelTris*12);
+
+		if(mScheduler == nullptr || mScheduler->ThreadCount() == 1 || levelTris < ParallelSubdivideMinTriangles)
+			SubdivideSerial(scratch.InputIndices, meshData, scratch.Midpoints, midPoint);
+		else
+			SubdivideParallel(mScheduler, meshData, scratch, midPoint);
 	}
 }
 
@@ -340,8 +651,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 	for(uint32 i = 0; i < 12; ++i)
 		meshData.Vertices[i].Position = pos[i];
 
-	for(uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	Subdivide(meshData, numSubdivisions);
 
 	// Project vertices onto sphere and scale.
 	for(uint32 i = 0; i < meshData.Vertices.size(); ++i)
@@ -389,6 +699,19 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 {
     MeshData meshData;
 
+	// Add one because we duplicate the first and last vertex per ring
+	// since the texture coordinates are different.
+	uint32 ringVertexCount = sliceCount+1;
+	uint32 ringCount = stackCount+1;
+
+	// The stacks, then each cap: a ring and its center vertex.
+	uint32 stackVertexCount = ringCount*ringVertexCount;
+	uint32 stackIndexCount = 6*sliceCount*stackCount;
+	uint32 capVertexCount = ringVertexCount + 1;
+	uint32 capIndexCount = 3*sliceCount;
+	meshData.Vertices.resize(stackVertexCount + 2*capVertexCount);
+	meshData.Indices32.resize(stackIndexCount + 2*capIndexCount);
+
 	//
 	// Build Stacks.
 	// 
@@ -398,83 +721,77 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 	// Amount to increment radius as we move up each stack level from bottom to top.
 	float radiusStep = (topRadius - bottomRadius) / stackCount;
 
-	uint32 ringCount = stackCount+1;
+	std::vector<XMFLOAT2> slices;
+	BuildSliceTable(sliceCount, slices);
+
+	// Cylinder can be parameterized as follows, where we introduce v
+	// parameter that goes in the same direction as the v tex-coord
+	// so that the bitangent goes in the same direction as the v tex-coord.
+	//   Let r0 be the bottom radius and let r1 be the top radius.
+	//   y(v) = h - hv for v in [0,1].
+	//   r(v) = r1 + (r0-r1)v
+	//
+	//   x(t, v) = r(v)*cos(t)
+	//   y(t, v) = h - hv
+	//   z(t, v) = r(v)*sin(t)
+	// 
+	//  dx/dt = -r(v)*sin(t)
+	//  dy/dt = 0
+	//  dz/dt = +r(v)*cos(t)
+	//
+	//  dx/dv = (r0-r1)*cos(t)
+	//  dy/dv = -h
+	//  dz/dv = (r0-r1)*sin(t)
+	//
+	// The unit tangent is T = (-sin(t), 0, cos(t)), and the normal T x dP/dv =
+	// (h*cos(t), r0-r1, h*sin(t)) has the same length all around.
+	float dr = bottomRadius-topRadius;
+	float invNormalLength = 1.0f / sqrtf(height*height + dr*dr);
+	float normalY = dr*invNormalLength;
+	float normalXZ = height*invNormalLength;
 
 	// Compute vertices for each stack ring starting at the bottom and moving up.
+	Vertex* v = meshData.Vertices.data();
 	for(uint32 i = 0; i < ringCount; ++i)
 	{
 		float y = -0.5f*height + i*stackHeight;
 		float r = bottomRadius + i*radiusStep;
+		float texV = 1.0f - (float)i/stackCount;
 
 		// vertices of ring
-		float dTheta = 2.0f*XM_PI/sliceCount;
 		for(uint32 j = 0; j <= sliceCount; ++j)
 		{
-			Vertex vertex;
-
-			float c = cosf(j*dTheta);
-			float s = sinf(j*dTheta);
-
-			vertex.Position = XMFLOAT3(r*c, y, r*s);
-
-			vertex.TexC.x = (float)j/sliceCount;
-			vertex.TexC.y = 1.0f - (float)i/stackCount;
-
-			// Cylinder can be parameterized as follows, where we introduce v
-			// parameter that goes in the same direction as the v tex-coord
-			// so that the bitangent goes in the same direction as the v tex-coord.
-			//   Let r0 be the bottom radius and let r1 be the top radius.
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(t, v) = r(v)*cos(t)
-			//   y(t, v) = h - hv
-			//   z(t, v) = r(v)*sin(t)
-			// 
-			//  dx/dt = -r(v)*sin(t)
-			//  dy/dt = 0
-			//  dz/dt = +r(v)*cos(t)
-			//
-			//  dx/dv = (r0-r1)*cos(t)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(t)
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = bottomRadius-topRadius;
-			XMFLOAT3 bitangent(dr*c, -height, dr*s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
+			float c = slices[j].x;
+			float s = slices[j].y;
+
+			StoreVertex(*v++,
+				_mm_setr_ps(r*c, y, r*s, normalXZ*c),
+				_mm_setr_ps(normalY, normalXZ*s, -s, 0.0f),
+				_mm_setr_ps(c, (float)j/sliceCount, texV, 0.0f));
 		}
 	}
 
-	// Add one because we duplicate the first and last vertex per ring
-	// since the texture coordinates are different.
-	uint32 ringVertexCount = sliceCount+1;
-
 	// Compute indices for each stack.
+	uint32* k = meshData.Indices32.data();
 	for(uint32 i = 0; i < stackCount; ++i)
 	{
+		uint32 row = i*ringVertexCount;
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
+			k[0] = row + j;
+			k[1] = row + ringVertexCount + j;
+			k[2] = row + ringVertexCount + j+1;
+
+			k[3] = row + j;
+			k[4] = row + ringVertexCount + j+1;
+			k[5] = row + j+1;
+			k += 6;
 		}
 	}
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
+	BuildCylinderTopCap(topRadius, height, slices, meshData, stackVertexCount, stackIndexCount);
+	BuildCylinderBottomCap(bottomRadius, height, slices, meshData,
+		stackVertexCount + capVertexCount, stackIndexCount + capIndexCount);
 
     return meshData;
 }
@@ -552,8 +869,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float fWidth, float f
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	Subdivide(meshData, numSubdivisions);
 
 	return meshData;
 }
@@ -627,8 +943,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float fWidth, float
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	Subdivide(meshData, numSubdivisions);
 
 	return meshData;
 }
@@ -705,8 +1020,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float fWidth, float
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	Subdivide(meshData, numSubdivisions);
 
 	return meshData;
 }
@@ -785,8 +1099,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float fWidt
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	Subdivide(meshData, numSubdivisions);
 
 	return meshData;
 }
@@ -892,84 +1205,96 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePentagonalPrism(float fWidt
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	Subdivide(meshData, numSubdivisions);
 
 	return meshData;
 }
 
-void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+void GeometryGenerator::BuildSliceTable(uint32 sliceCount, std::vector<XMFLOAT2>& slices)
 {
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
+	slices.resize(sliceCount + 1);
 
-	float y = 0.5f*height;
 	float dTheta = 2.0f*XM_PI/sliceCount;
+	for(uint32 j = 0; j <= sliceCount; ++j)
+		slices[j] = XMFLOAT2(cosf(j*dTheta), sinf(j*dTheta));
+}
+
+void GeometryGenerator::BuildCylinderTopCap(float topRadius, float height, const std::vector<XMFLOAT2>& slices,
+											MeshData& meshData, uint32 firstVertex, uint32 firstIndex)
+{
+	uint32 sliceCount = (uint32)slices.size() - 1;
+	Vertex* v = &meshData.Vertices[firstVertex];
+	uint32* k = &meshData.Indices32[firstIndex];
+
+	float y = 0.5f*height;
 
 	// Duplicate cap ring vertices because the texture coordinates and normals differ.
 	for(uint32 i = 0; i <= sliceCount; ++i)
 	{
-		float x = topRadius*cosf(i*dTheta);
-		float z = topRadius*sinf(i*dTheta);
+		float x = topRadius*slices[i].x;
+		float z = topRadius*slices[i].y;
 
 		// Scale down by the height to try and make top cap texture coord area
 		// proportional to base.
 		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
+		float texV = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		*v++ = Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, texV);
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	*v = Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
 
 	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = firstVertex + sliceCount + 1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
+		k[0] = centerIndex;
+		k[1] = firstVertex + i+1;
+		k[2] = firstVertex + i;
+		k += 3;
 	}
 }
 
-void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float height, const std::vector<XMFLOAT2>& slices,
+											   MeshData& meshData, uint32 firstVertex, uint32 firstIndex)
 {
 	// 
 	// Build bottom cap.
 	//
 
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
+	uint32 sliceCount = (uint32)slices.size() - 1;
+	Vertex* v = &meshData.Vertices[firstVertex];
+	uint32* k = &meshData.Indices32[firstIndex];
 	float y = -0.5f*height;
 
 	// vertices of ring
-	float dTheta = 2.0f*XM_PI/sliceCount;
 	for(uint32 i = 0; i <= sliceCount; ++i)
 	{
-		float x = bottomRadius*cosf(i*dTheta);
-		float z = bottomRadius*sinf(i*dTheta);
+		float x = bottomRadius*slices[i].x;
+		float z = bottomRadius*slices[i].y;
 
 		// Scale down by the height to try and make top cap texture coord area
 		// proportional to base.
 		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
+		float texV = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		*v++ = Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, texV);
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	*v = Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
 
 	// Cache the index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = firstVertex + sliceCount + 1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
+		k[0] = centerIndex;
+		k[1] = firstVertex + i;
+		k[2] = firstVertex + i+1;
+		k += 3;
 	}
 }
 
@@ -994,20 +1319,30 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	float dv = 1.0f / (m-1);
 
 	meshData.Vertices.resize(vertexCount);
+
+	// Only x and u change along a row, and only z and v down the columns.  The
+	// constant parts of a vertex sit in registers and the rest is one multiply-add
+	// (separately rounded, so the result matches -halfWidth + j*dx exactly).
+	const __m128 rowStep = _mm_setr_ps(dx, 0.0f, 0.0f, 0.0f);
+	const __m128 texStep = _mm_setr_ps(0.0f, du, 0.0f, 0.0f);
+	const __m128 normalTangent = _mm_setr_ps(1.0f, 0.0f, 1.0f, 0.0f);
+
+	Vertex* v = meshData.Vertices.data();
 	for(uint32 i = 0; i < m; ++i)
 	{
 		float z = halfDepth - i*dz;
-		for(uint32 j = 0; j < n; ++j)
-		{
-			float x = -halfWidth + j*dx;
+		__m128 rowStart = _mm_setr_ps(-halfWidth, 0.0f, z, 0.0f);
 
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		// Stretch texture over grid.
+		__m128 texStart = _mm_setr_ps(0.0f, 0.0f, i*dv, 0.0f);
 
-			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
+		for(uint32 j = 0; j < n; ++j)
+		{
+			__m128 fj = _mm_set1_ps((float)j);
+			StoreVertex(*v++,
+				_mm_add_ps(_mm_mul_ps(fj, rowStep), rowStart),
+				normalTangent,
+				_mm_add_ps(_mm_mul_ps(fj, texStep), texStart));
 		}
 	}
  
@@ -1018,18 +1353,19 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	meshData.Indices32.resize(faceCount*3); // 3 indices per face
 
 	// Iterate over each quad and compute indices.
-	uint32 k = 0;
+	uint32* k = meshData.Indices32.data();
 	for(uint32 i = 0; i < m-1; ++i)
 	{
+		uint32 row = i*n;
 		for(uint32 j = 0; j < n-1; ++j)
 		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
+			k[0] = row + j;
+			k[1] = row + j+1;
+			k[2] = row + n+j;
 
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
+			k[3] = row + n+j;
+			k[4] = row + j+1;
+			k[5] = row + n+j+1;
 
 			k += 6; // next quad
 		}
@@ -14,10 +14,13 @@
 
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <DirectXMath.h>
 #include <vector>
 
+class TaskScheduler;
+
 class GeometryGenerator
 {
 public:
@@ -58,8 +61,27 @@ public:
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 
+		// Largest number of vertices a 16-bit index can address.
+		static const uint32 MaxVertices16 = 1u << 16;
+
+		// True when some index does not fit in 16 bits, so the mesh must be drawn
+		// with 32-bit indices.
+		bool Needs32BitIndices()const
+		{
+			for(uint32 index : Indices32)
+			{
+				if(index >= MaxVertices16)
+					return true;
+			}
+			return false;
+		}
+
+		// Indices32 truncated to 16 bits; only valid when !Needs32BitIndices().
         std::vector<uint16>& GetIndices16()
         {
+#if defined(DEBUG) || defined(_DEBUG)
+			assert(!Needs32BitIndices());
+#endif
 			if(mIndices16.empty())
 			{
 				mIndices16.resize(Indices32.size());
@@ -74,6 +96,12 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	///<summary>
+	/// With a scheduler, subdivision of large meshes is spread over its threads.
+	/// The output is the same either way.
+	///</summary>
+	explicit GeometryGenerator(TaskScheduler* scheduler = nullptr);
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -122,10 +150,26 @@ public:
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 	void Subdivide(MeshData& meshData);
+
+	///<summary>
+	/// Subdivides numSubdivisions times in one call, reusing the scratch memory
+	/// between levels.  Same result as calling Subdivide(meshData) repeatedly.
+	///</summary>
+	void Subdivide(MeshData& meshData, uint32 numSubdivisions);
 private:
 	
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+
+    // (cos, sin) of j*2pi/sliceCount for j = 0..sliceCount, shared by every ring.
+    void BuildSliceTable(uint32 sliceCount, std::vector<DirectX::XMFLOAT2>& slices);
+    // Write a cap's ring and center vertex from meshData.Vertices[firstVertex] and its
+    // triangles from meshData.Indices32[firstIndex], which the caller has sized.
+    void BuildCylinderTopCap(float topRadius, float height, const std::vector<DirectX::XMFLOAT2>& slices,
+                             MeshData& meshData, uint32 firstVertex, uint32 firstIndex);
+    void BuildCylinderBottomCap(float bottomRadius, float height, const std::vector<DirectX::XMFLOAT2>& slices,
+                                MeshData& meshData, uint32 firstVertex, uint32 firstIndex);
+
+private:
+    TaskScheduler* mScheduler = nullptr;
 };
 
@@ -0,0 +1,343 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+
+namespace
+{
+    using uint32 = MeshOptimizer::uint32;
+
+    // The cache Forsyth's heuristic models: least recently used, 32 entries.  Scoring
+    // against a larger cache than the hardware's costs little on a FIFO of 16 and
+    // keeps the order good on GPUs with larger caches.
+    const int ScoreCacheSize = 32;
+
+    const float CacheDecayPower = 1.5f;
+    const float LastTriangleScore = 0.75f;
+    const float ValenceBoostScale = 2.0f;
+    const float ValenceBoostPower = 0.5f;
+
+    // Vertices with more remaining triangles than this all score alike.
+    const uint32 MaxScoredValence = 32;
+
+    const uint32 NoTriangle = ~0u;
+
+    // Score of a vertex at cachePosition (-1 when not cached) with valence triangles
+    // still to draw.  Recently used vertices score high, except that the three of the
+    // triangle just drawn score a little lower so strips do not run into corners, and
+    // vertices with few triangles left get a boost so they are finished off.
+    float VertexScore(int cachePosition, uint32 valence)
+    {
+        if(valence == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if(cachePosition >= 0)
+        {
+            if(cachePosition < 3)
+            {
+                score = LastTriangleScore;
+            }
+            else
+            {
+                float scale = 1.0f / (ScoreCacheSize - 3);
+                score = std::pow(1.0f - (cachePosition - 3)*scale, CacheDecayPower);
+            }
+        }
+
+        return score + ValenceBoostScale * std::pow((float)valence, -ValenceBoostPower);
+    }
+
+    // VertexScore for every cache position and valence, so the inner loop never
+    // calls pow.
+    struct VertexScoreTable
+    {
+        float Scores[ScoreCacheSize + 1][MaxScoredValence + 1];
+
+        VertexScoreTable()
+        {
+            for(int position = -1; position < ScoreCacheSize; ++position)
+            {
+                for(uint32 valence = 0; valence <= MaxScoredValence; ++valence)
+                    Scores[position + 1][valence] = VertexScore(position, valence);
+            }
+        }
+
+        float operator()(int cachePosition, uint32 valence)const
+        {
+            return Scores[cachePosition + 1][std::min(valence, MaxScoredValence)];
+        }
+    };
+
+    // A vertex rounded to the weld steps.
+    struct WeldKey
+    {
+        std::int32_t Values[8];
+
+        bool operator==(const WeldKey& rhs)const
+        {
+            return std::equal(Values, Values + 8, rhs.Values);
+        }
+    };
+
+    struct WeldKeyHash
+    {
+        std::size_t operator()(const WeldKey& key)const
+        {
+            std::uint64_t hash = 14695981039346656037ull;
+            for(std::int32_t value : key.Values)
+                hash = (hash ^ (std::uint32_t)value) * 1099511628211ull;
+            return (std::size_t)hash;
+        }
+    };
+
+    std::int32_t Quantize(float value, float step)
+    {
+        return (std::int32_t)std::floor((double)value/step + 0.5);
+    }
+}
+
+std::size_t MeshOptimizer::WeldVertices(GeometryGenerator::MeshData& meshData, float positionStep,
+                                        float normalStep, float texCStep)
+{
+    std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+
+    std::unordered_map<WeldKey, uint32, WeldKeyHash> welded;
+    welded.reserve(vertices.size());
+
+    std::vector<uint32> remap(vertices.size());
+    std::vector<GeometryGenerator::Vertex> output;
+    output.reserve(vertices.size());
+
+    for(std::size_t i = 0; i < vertices.size(); ++i)
+    {
+        const GeometryGenerator::Vertex& v = vertices[i];
+
+        WeldKey key =
+        {{
+            Quantize(v.Position.x, positionStep), Quantize(v.Position.y, positionStep), Quantize(v.Position.z, positionStep),
+            Quantize(v.Normal.x, normalStep), Quantize(v.Normal.y, normalStep), Quantize(v.Normal.z, normalStep),
+            Quantize(v.TexC.x, texCStep), Quantize(v.TexC.y, texCStep)
+        }};
+
+        auto inserted = welded.emplace(key, (uint32)output.size());
+        if(inserted.second)
+            output.push_back(v);
+
+        remap[i] = inserted.first->second;
+    }
+
+    for(uint32& index : meshData.Indices32)
+        index = remap[index];
+
+    std::size_t removed = vertices.size() - output.size();
+    vertices.swap(output);
+    return removed;
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32>& indices, std::size_t vertexCount,
+                                                            uint32 cacheSize)
+{
+    CacheStats stats;
+    if(indices.empty() || cacheSize == 0)
+        return stats;
+
+    // A vertex is in the cache while fewer than cacheSize misses have happened since
+    // it was last loaded.
+    std::vector<std::size_t> loadedAt(vertexCount, 0);
+    std::size_t misses = 0;
+    std::size_t distinct = 0;
+
+    for(uint32 v : indices)
+    {
+        if(loadedAt[v] == 0)
+            ++distinct;
+
+        if(loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize)
+        {
+            ++misses;
+            loadedAt[v] = misses;
+        }
+    }
+
+    stats.Acmr = (float)misses / (float)(indices.size()/3);
+    stats.Atvr = (float)misses / (float)distinct;
+    return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32>& indices, std::size_t vertexCount)
+{
+    static const VertexScoreTable vertexScore;
+
+    uint32 numTris = (uint32)indices.size()/3;
+    if(numTris == 0)
+        return;
+
+    //
+    // Triangles that use each vertex, packed into one array.  The first valence[v]
+    // entries of a vertex's range are the triangles not drawn yet.
+    //
+
+    std::vector<uint32> valence(vertexCount, 0);
+    for(uint32 v : indices)
+        ++valence[v];
+
+    std::vector<uint32> adjacencyOffset(vertexCount + 1);
+    adjacencyOffset[0] = 0;
+    for(std::size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+    std::vector<uint32> adjacency(indices.size());
+    {
+        std::vector<uint32> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for(uint32 i = 0; i < (uint32)indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = i/3;
+    }
+
+    std::vector<float> score(vertexCount);
+    for(std::size_t v = 0; v < vertexCount; ++v)
+        score[v] = vertexScore(-1, valence[v]);
+
+    std::vector<float> triangleScore(numTris);
+    for(uint32 t = 0; t < numTris; ++t)
+        triangleScore[t] = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+
+    std::vector<bool> drawn(numTris, false);
+    std::vector<uint32> output(indices.size());
+
+    // The cache before and after drawing a triangle, with room for its three
+    // vertices in front of a full cache.
+    int cacheBuffers[2][ScoreCacheSize + 3];
+    int* cache = cacheBuffers[0];
+    int* newCache = cacheBuffers[1];
+    int cacheCount = 0;
+
+    uint32 best = 0;
+    uint32 nextUndrawn = 0;
+
+    for(uint32 drawnCount = 0; drawnCount < numTris; ++drawnCount)
+    {
+        // Nothing in the cache has triangles left: continue with the first triangle
+        // not drawn yet.
+        if(best == NoTriangle)
+        {
+            while(drawn[nextUndrawn])
+                ++nextUndrawn;
+            best = nextUndrawn;
+        }
+
+        const uint32* tri = &indices[best*3];
+        std::copy(tri, tri + 3, &output[drawnCount*3]);
+        drawn[best] = true;
+
+        // Take the triangle off its vertices' lists and put the vertices at the
+        // front of the cache, pushing the others back.
+        int newCount = 0;
+        for(int c = 0; c < 3; ++c)
+        {
+            uint32 v = tri[c];
+
+            uint32* begin = &adjacency[adjacencyOffset[v]];
+            uint32* last = begin + valence[v] - 1;
+            *std::find(begin, last, best) = *last;
+            *last = best;
+            --valence[v];
+
+            if(std::find(newCache, newCache + newCount, (int)v) == newCache + newCount)
+                newCache[newCount++] = (int)v;
+        }
+
+        for(int c = 0; c < cacheCount; ++c)
+        {
+            int v = cache[c];
+            if(v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2])
+                newCache[newCount++] = v;
+        }
+
+        // Rescore the vertices that moved, including those pushed out of the cache,
+        // and the triangles they still have to draw.
+        for(int c = 0; c < newCount; ++c)
+        {
+            int v = newCache[c];
+
+            float newScore = vertexScore(c < ScoreCacheSize ? c : -1, valence[v]);
+            float delta = newScore - score[v];
+            score[v] = newScore;
+
+            const uint32* begin = &adjacency[adjacencyOffset[v]];
+            for(const uint32* t = begin; t != begin + valence[v]; ++t)
+                triangleScore[*t] += delta;
+        }
+
+        std::swap(cache, newCache);
+        cacheCount = std::min(newCount, ScoreCacheSize);
+
+        // The best triangle left on a cached vertex is drawn next.
+        best = NoTriangle;
+        float bestScore = -1.0f;
+        for(int c = 0; c < cacheCount; ++c)
+        {
+            int v = cache[c];
+
+            const uint32* begin = &adjacency[adjacencyOffset[v]];
+            for(const uint32* t = begin; t != begin + valence[v]; ++t)
+            {
+                if(triangleScore[*t] > bestScore)
+                {
+                    bestScore = triangleScore[*t];
+                    best = *t;
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(GeometryGenerator::MeshData& meshData)
+{
+    std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+
+    std::vector<uint32> remap(vertices.size(), ~0u);
+    std::vector<GeometryGenerator::Vertex> output;
+    output.reserve(vertices.size());
+
+    for(uint32& index : meshData.Indices32)
+    {
+        if(remap[index] == ~0u)
+        {
+            remap[index] = (uint32)output.size();
+            output.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(output);
+}
+
+MeshOptimizer::Report MeshOptimizer::Optimize(GeometryGenerator::MeshData& meshData)
+{
+    Report report;
+    report.Before = AnalyzeVertexCache(meshData.Indices32, meshData.Vertices.size());
+
+    OptimizeVertexCache(meshData.Indices32, meshData.Vertices.size());
+    OptimizeVertexFetch(meshData);
+
+    report.After = AnalyzeVertexCache(meshData.Indices32, meshData.Vertices.size());
+    return report;
+}
+
+void MeshOptimizer::Trace(const char* meshName, const Report& report)
+{
+    char text[256];
+    std::snprintf(text, sizeof(text), "%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", meshName,
+                  report.Before.Acmr, report.After.Acmr, report.Before.Atvr, report.After.Atvr);
+    OutputDebugStringA(text);
+}
@@ -0,0 +1,71 @@
+//***************************************************************************************
+// MeshOptimizer.h
+//
+// Load-time reordering of GeometryGenerator meshes for the GPU.
+//
+// The generators emit triangles in the order they are easiest to build: ring by ring,
+// face by face, or as the subdivision produced them.  OptimizeVertexCache reorders
+// the triangles so consecutive ones share recently transformed vertices (Tom
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"), and OptimizeVertexFetch then
+// renumbers the vertices in the order the new index list first uses them, so vertex
+// fetch walks the vertex buffer front to back.  Neither changes what is drawn.
+// WeldVertices merges duplicate vertices beforehand so they can be shared.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+class MeshOptimizer
+{
+public:
+    using uint32 = std::uint32_t;
+
+    // Post-transform cache statistics of an index list.
+    struct CacheStats
+    {
+        // Average cache miss ratio: vertices transformed per triangle.  3 is the
+        // worst; a large regular mesh can approach 0.5.
+        float Acmr = 0.0f;
+
+        // Average transform to vertex ratio: vertices transformed per distinct
+        // vertex referenced.  1 means every vertex is transformed exactly once.
+        float Atvr = 0.0f;
+    };
+
+    struct Report
+    {
+        CacheStats Before;
+        CacheStats After;
+    };
+
+    // Size of the FIFO cache AnalyzeVertexCache simulates by default, a typical
+    // post-transform cache.
+    static const uint32 DefaultCacheSize = 16;
+
+    // Merges vertices whose position, normal and texture coordinates round to the
+    // same multiples of the given steps, keeping the first of each group, and
+    // remaps the indices to match.  Returns the number of vertices removed.
+    static std::size_t WeldVertices(GeometryGenerator::MeshData& meshData, float positionStep = 1e-5f,
+                                    float normalStep = 1e-3f, float texCStep = 1e-5f);
+
+    // Simulates drawing indices through a FIFO cache of cacheSize vertices.
+    static CacheStats AnalyzeVertexCache(const std::vector<uint32>& indices, std::size_t vertexCount,
+                                         uint32 cacheSize = DefaultCacheSize);
+
+    // Reorders the triangles of indices, keeping the winding of each.
+    static void OptimizeVertexCache(std::vector<uint32>& indices, std::size_t vertexCount);
+
+    // Renumbers the vertices in order of first use and drops unreferenced ones.
+    static void OptimizeVertexFetch(GeometryGenerator::MeshData& meshData);
+
+    // Both of the above, with the cache statistics before and after.  Call before
+    // meshData.GetIndices16(), which caches its result.
+    static Report Optimize(GeometryGenerator::MeshData& meshData);
+
+    // Writes a report to the debugger output.
+    static void Trace(const char* meshName, const Report& report);
+};
@@ -0,0 +1,213 @@
+//***************************************************************************************
+// TaskScheduler.cpp
+//***************************************************************************************
+
+#include "TaskScheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Identifies the worker queue of the scheduler that owns the current thread.
+    thread_local const TaskScheduler* tOwner = nullptr;
+    thread_local int tQueueIndex = 0;
+
+    // Attempts to find work before an idle worker goes to sleep.
+    const int IdleSpinCount = 64;
+}
+
+TaskScheduler::TaskScheduler(int threadCount)
+{
+    if(threadCount <= 0)
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+
+    mQueuedTasks = 0;
+    mSleepingWorkers = 0;
+    mQuit = false;
+
+    for(int i = 0; i < threadCount; ++i)
+        mQueues.push_back(std::make_unique<WorkQueue>());
+
+    for(int i = 1; i < threadCount; ++i)
+        mWorkers.emplace_back(&TaskScheduler::WorkerMain, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mQuit = true;
+    }
+    mWakeUp.notify_all();
+
+    for(auto& worker : mWorkers)
+        worker.join();
+}
+
+int TaskScheduler::ThreadCount()const
+{
+    return (int)mWorkers.size() + 1;
+}
+
+int TaskScheduler::DefaultGrainSize(int count)const
+{
+    return std::max(1, count / (4*ThreadCount()));
+}
+
+void TaskScheduler::Run(int begin, int end, int grainSize, RangeFunc func, void* context)
+{
+    if(end <= begin)
+        return;
+
+    grainSize = std::max(1, grainSize);
+
+    // Nothing to share; skip the queues entirely.
+    if(mWorkers.empty() || end - begin <= grainSize)
+    {
+        func(context, begin, end);
+        return;
+    }
+
+    Job job;
+    job.Func = func;
+    job.Context = context;
+    job.GrainSize = grainSize;
+    job.Remaining = end - begin;
+
+    int queueIndex = CurrentQueueIndex();
+
+    Task root;
+    root.Owner = &job;
+    root.Begin = begin;
+    root.End = end;
+    Execute(queueIndex, root);
+
+    // Keep working (on this job or any other) until every range of the job has
+    // finished.  The job lives on this stack frame, so we must not return early.
+    while(job.Remaining.load(std::memory_order_acquire) > 0)
+    {
+        Task task;
+        if(FindTask(queueIndex, task))
+            Execute(queueIndex, task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void TaskScheduler::WorkerMain(int queueIndex)
+{
+    tOwner = this;
+    tQueueIndex = queueIndex;
+
+    int idleSpins = 0;
+    while(!mQuit)
+    {
+        Task task;
+        if(FindTask(queueIndex, task))
+        {
+            Execute(queueIndex, task);
+            idleSpins = 0;
+            continue;
+        }
+
+        if(++idleSpins < IdleSpinCount)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Sleep until somebody queues a task.  Push() reads mSleepingWorkers after it
+        // bumps mQueuedTasks, so one of the two sides always sees the other.
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleepingWorkers++;
+        mWakeUp.wait(lock, [this]{ return mQuit || mQueuedTasks.load() > 0; });
+        mSleepingWorkers--;
+        idleSpins = 0;
+    }
+}
+
+int TaskScheduler::CurrentQueueIndex()const
+{
+    return tOwner == this ? tQueueIndex : 0;
+}
+
+void TaskScheduler::Push(int queueIndex, const Task& task)
+{
+    WorkQueue& queue = *mQueues[queueIndex];
+    {
+        std::lock_guard<std::mutex> lock(queue.Mutex);
+        queue.Tasks.push_back(task);
+    }
+
+    mQueuedTasks++;
+
+    if(mSleepingWorkers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mWakeUp.notify_one();
+    }
+}
+
+bool TaskScheduler::Pop(int queueIndex, Task& task)
+{
+    // The owner takes the most recently split (smallest, cache-warm) range.
+    WorkQueue& queue = *mQueues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.Mutex);
+    if(queue.Tasks.empty())
+        return false;
+
+    task = queue.Tasks.back();
+    queue.Tasks.pop_back();
+    mQueuedTasks--;
+    return true;
+}
+
+bool TaskScheduler::Steal(int thiefIndex, Task& task)
+{
+    // Thieves take the oldest (largest) range so they do not come back for more soon.
+    int queueCount = (int)mQueues.size();
+    for(int k = 1; k < queueCount; ++k)
+    {
+        WorkQueue& queue = *mQueues[(thiefIndex + k) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.Mutex);
+        if(queue.Tasks.empty())
+            continue;
+
+        task = queue.Tasks.front();
+        queue.Tasks.pop_front();
+        mQueuedTasks--;
+        return true;
+    }
+
+    return false;
+}
+
+bool TaskScheduler::FindTask(int queueIndex, Task& task)
+{
+    if(mQueuedTasks.load() == 0)
+        return false;
+
+    return Pop(queueIndex, task) || Steal(queueIndex, task);
+}
+
+void TaskScheduler::Execute(int queueIndex, Task task)
+{
+    Job* job = task.Owner;
+
+    // Split lazily: hand the upper half to whoever wants it and keep the lower half.
+    while(task.End - task.Begin > job->GrainSize)
+    {
+        Task upper;
+        upper.Owner = job;
+        upper.Begin = task.Begin + (task.End - task.Begin)/2;
+        upper.End = task.End;
+        Push(queueIndex, upper);
+
+        task.End = upper.Begin;
+    }
+
+    job->Func(job->Context, task.Begin, task.End);
+
+    // Last access to the job; its owner may return as soon as this reaches zero.
+    job->Remaining.fetch_sub(task.End - task.Begin, std::memory_order_acq_rel);
+}
@@ -0,0 +1,131 @@
+//***************************************************************************************
+// TaskScheduler.h
+//
+// Small portable work-stealing thread pool for data-parallel CPU passes.
+//
+// Every thread owns a deque of index ranges.  A thread splits the range it is about
+// to run in half until it is no larger than the grain size, pushing the upper halves
+// onto the back of its own deque; idle threads steal from the front of other deques,
+// which always holds the largest remaining ranges.  The thread that calls ParallelFor
+// takes part in the work (and in stealing) until the whole range has finished, so
+// ParallelFor may be nested or called from several threads at once.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskScheduler
+{
+public:
+    // threadCount is the total number of threads that run work, including the
+    // thread calling ParallelFor.  Zero uses one thread per hardware thread, and
+    // one runs everything on the calling thread.
+    explicit TaskScheduler(int threadCount = 0);
+    TaskScheduler(const TaskScheduler& rhs) = delete;
+    TaskScheduler& operator=(const TaskScheduler& rhs) = delete;
+    ~TaskScheduler();
+
+    int ThreadCount()const;
+
+    // Calls func(i) for every i in [begin, end) and returns once all calls are done.
+    // Ranges are never split below grainSize indices.
+    template<typename Func>
+    void ParallelFor(int begin, int end, int grainSize, const Func& func)
+    {
+        struct Context
+        {
+            const Func* Body;
+
+            static void Invoke(void* context, int first, int last)
+            {
+                const Func& body = *static_cast<Context*>(context)->Body;
+                for(int i = first; i < last; ++i)
+                    body(i);
+            }
+        };
+
+        Context context = { &func };
+        Run(begin, end, grainSize, &Context::Invoke, &context);
+    }
+
+    // Same as above with a grain size that gives each thread several ranges to steal.
+    template<typename Func>
+    void ParallelFor(int begin, int end, const Func& func)
+    {
+        ParallelFor(begin, end, DefaultGrainSize(end - begin), func);
+    }
+
+    int DefaultGrainSize(int count)const;
+
+private:
+    typedef void (*RangeFunc)(void* context, int first, int last);
+
+    struct Job
+    {
+        RangeFunc Func = nullptr;
+        void* Context = nullptr;
+        int GrainSize = 1;
+
+        // Number of indices that have not finished running yet.
+        std::atomic<int> Remaining;
+    };
+
+    struct Task
+    {
+        Job* Owner = nullptr;
+        int Begin = 0;
+        int End = 0;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex Mutex;
+        std::deque<Task> Tasks;
+    };
+
+    void Run(int begin, int end, int grainSize, RangeFunc func, void* context);
+    void WorkerMain(int queueIndex);
+
+    int CurrentQueueIndex()const;
+    void Push(int queueIndex, const Task& task);
+    bool Pop(int queueIndex, Task& task);
+    bool Steal(int thiefIndex, Task& task);
+    bool FindTask(int queueIndex, Task& task);
+    void Execute(int queueIndex, Task task);
+
+private:
+    // Queue 0 is shared by all threads that are not workers of this scheduler;
+    // queue k > 0 belongs to worker k.
+    std::vector<std::unique_ptr<WorkQueue>> mQueues;
+    std::vector<std::thread> mWorkers;
+
+    std::atomic<int> mQueuedTasks;
+    std::atomic<int> mSleepingWorkers;
+    std::atomic<bool> mQuit;
+
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeUp;
+};
+
+// Runs func(i) for i in [begin, end) on scheduler, or serially on the calling thread
+// when no scheduler is given.
+template<typename Func>
+void ParallelFor(TaskScheduler* scheduler, int begin, int end, int grainSize, const Func& func)
+{
+    if(scheduler != nullptr)
+    {
+        scheduler->ParallelFor(begin, end, grainSize, func);
+    }
+    else
+    {
+        for(int i = begin; i < end; ++i)
+            func(i);
+    }
+}
@@ -0,0 +1,410 @@
+//***************************************************************************************
+// VertexFormat.h
+//
+// Compile-time vertex format descriptions.  A format is declared once as a list of
+// elements, each a semantic and an encoding:
+//
+//   using VertexLayout = VertexFormat::Layout<
+//       VertexFormat::Element<VertexFormat::Position, VertexFormat::Float3>,
+//       VertexFormat::Element<VertexFormat::Normal, VertexFormat::Snorm16x4>,
+//       VertexFormat::Element<VertexFormat::TexCoord, VertexFormat::Half2>>;
+//
+// and the stride, the D3D12 input layout and a conversion from any source vertex
+// type all follow from it.  Elements are packed in order with no padding.  The
+// conversion is unrolled at compile time: for each element, one SIMD load of the
+// source member the semantic names, the encoding's pack and one store.  Source
+// members no element uses (a tangent, say) are never read.
+//
+// Some semantics transform the value before it is packed, so that a compact
+// encoding can hold it: QuantizedPosition stores the position relative to the
+// mesh's bounding box, in [-1, 1] per axis for a 16-bit normalized encoding, and
+// OctahedralNormal folds the unit normal to two components.  The shader undoes
+// both, the first with the bounds from the object constants.
+//***************************************************************************************
+
+#pragma once
+
+#include <d3d12.h>
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <cfloat>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace VertexFormat
+{
+    //
+    // Source attributes, loaded into a vector with the unused lanes zero.
+    //
+
+    inline DirectX::XMVECTOR LoadAttribute(float v) { return DirectX::XMVectorSet(v, 0.0f, 0.0f, 0.0f); }
+    inline DirectX::XMVECTOR LoadAttribute(const DirectX::XMFLOAT2& v) { return DirectX::XMLoadFloat2(&v); }
+    inline DirectX::XMVECTOR LoadAttribute(const DirectX::XMFLOAT3& v) { return DirectX::XMLoadFloat3(&v); }
+    inline DirectX::XMVECTOR LoadAttribute(const DirectX::XMFLOAT4& v) { return DirectX::XMLoadFloat4(&v); }
+
+    // Projects the unit vector n onto the octahedron |x|+|y|+|z| = 1 and flattens it
+    // to the xz-plane, folding the lower half (y < 0) over the corners; the result
+    // is in x and y.  Matches WaterSurface::EncodeOctahedral and is decoded by
+    // DecodeOctahedral in Default.hlsl.  A zero vector encodes as +y.
+    inline DirectX::XMVECTOR EncodeOctahedral(DirectX::FXMVECTOR n)
+    {
+        DirectX::XMFLOAT3 v;
+        DirectX::XMStoreFloat3(&v, n);
+
+        float l1 = std::fabs(v.x) + std::fabs(v.y) + std::fabs(v.z);
+        if(l1 == 0.0f)
+            return DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+
+        float invL1 = 1.0f / l1;
+        float u = v.x*invL1;
+        float w = v.z*invL1;
+        if(v.y < 0.0f)
+        {
+            float foldU = (1.0f - std::fabs(w)) * (u >= 0.0f ? 1.0f : -1.0f);
+            float foldW = (1.0f - std::fabs(u)) * (w >= 0.0f ? 1.0f : -1.0f);
+            u = foldU;
+            w = foldW;
+        }
+
+        return DirectX::XMVectorSet(u, w, 0.0f, 0.0f);
+    }
+
+    // What a conversion knows about the mesh besides its vertices.
+    struct ConvertContext
+    {
+        // Box around the mesh's positions, the one QuantizedPosition stores them
+        // relative to.
+        DirectX::BoundingBox Bounds;
+    };
+
+    //
+    // Semantics: the HLSL semantic name and the member a source vertex keeps the
+    // value in.  Load is only instantiated for formats that are converted, so a
+    // source type only needs the members its format uses.
+    //
+
+    struct Position
+    {
+        static const char* Name() { return "POSITION"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext&) { return LoadAttribute(v.Position); }
+    };
+
+    // The position as (p - Bounds.Center) / Bounds.Extents.  An axis along which
+    // the mesh is flat loads as 0.
+    struct QuantizedPosition
+    {
+        static const char* Name() { return "POSITION"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext& context)
+        {
+            DirectX::XMVECTOR center = DirectX::XMLoadFloat3(&context.Bounds.Center);
+            DirectX::XMVECTOR extents = DirectX::XMLoadFloat3(&context.Bounds.Extents);
+            return DirectX::XMVectorDivide(DirectX::XMVectorSubtract(LoadAttribute(v.Position), center),
+                                           DirectX::XMVectorMax(extents, DirectX::XMVectorReplicate(FLT_MIN)));
+        }
+    };
+
+    struct Normal
+    {
+        static const char* Name() { return "NORMAL"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext&) { return LoadAttribute(v.Normal); }
+    };
+
+    // The normal, octahedral encoded in x and y.
+    struct OctahedralNormal
+    {
+        static const char* Name() { return "NORMAL"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext&)
+        {
+            return EncodeOctahedral(LoadAttribute(v.Normal));
+        }
+    };
+
+    struct Tangent
+    {
+        static const char* Name() { return "TANGENT"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext&) { return LoadAttribute(v.TangentU); }
+    };
+
+    struct TexCoord
+    {
+        static const char* Name() { return "TEXCOORD"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext&) { return LoadAttribute(v.TexC); }
+    };
+
+    struct Color
+    {
+        static const char* Name() { return "COLOR"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext&) { return LoadAttribute(v.Color); }
+    };
+
+    struct Size
+    {
+        static const char* Name() { return "SIZE"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext&) { return LoadAttribute(v.Size); }
+    };
+
+    struct Height
+    {
+        static const char* Name() { return "HEIGHT"; }
+        template<class Source> static DirectX::XMVECTOR Load(const Source& v, const ConvertContext&) { return LoadAttribute(v.Height); }
+    };
+
+    //
+    // Encodings: how an element is stored, its DXGI format, the pack from the loaded
+    // vector and the unpack the input assembler does.  MaxError bounds how far a
+    // component of value v can move in the round trip.  dest and src need not be
+    // aligned.
+    //
+
+    // Round to nearest keeps half of the last place: 2^-11 of the value, or half
+    // the smallest subnormal.
+    inline float HalfError(float v) { return std::fabs(v)*(1.0f/2048.0f) + 2.98e-8f; }
+
+    // Half a step of scale steps per unit, plus whatever clamping to the range cuts
+    // off.
+    inline float SnormError(float v, float scale) { return std::max(std::fabs(v) - 1.0f, 0.0f) + 0.5f/scale; }
+    inline float UnormError(float v, float scale) { return std::max(-v, 0.0f) + std::max(v - 1.0f, 0.0f) + 0.5f/scale; }
+
+    struct Float1
+    {
+        using Storage = float;
+        static const UINT Components = 1;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R32_FLOAT;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::XMStoreFloat(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::XMLoadFloat(static_cast<const Storage*>(src)); }
+        static float MaxError(float) { return 0.0f; }
+    };
+
+    struct Float2
+    {
+        using Storage = DirectX::XMFLOAT2;
+        static const UINT Components = 2;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R32G32_FLOAT;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::XMStoreFloat2(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::XMLoadFloat2(static_cast<const Storage*>(src)); }
+        static float MaxError(float) { return 0.0f; }
+    };
+
+    struct Float3
+    {
+        using Storage = DirectX::XMFLOAT3;
+        static const UINT Components = 3;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R32G32B32_FLOAT;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::XMStoreFloat3(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::XMLoadFloat3(static_cast<const Storage*>(src)); }
+        static float MaxError(float) { return 0.0f; }
+    };
+
+    struct Float4
+    {
+        using Storage = DirectX::XMFLOAT4;
+        static const UINT Components = 4;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::XMStoreFloat4(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::XMLoadFloat4(static_cast<const Storage*>(src)); }
+        static float MaxError(float) { return 0.0f; }
+    };
+
+    struct Half2
+    {
+        using Storage = DirectX::PackedVector::XMHALF2;
+        static const UINT Components = 2;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R16G16_FLOAT;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::PackedVector::XMStoreHalf2(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::PackedVector::XMLoadHalf2(static_cast<const Storage*>(src)); }
+        static float MaxError(float v) { return HalfError(v); }
+    };
+
+    struct Half4
+    {
+        using Storage = DirectX::PackedVector::XMHALF4;
+        static const UINT Components = 4;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::PackedVector::XMStoreHalf4(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::PackedVector::XMLoadHalf4(static_cast<const Storage*>(src)); }
+        static float MaxError(float v) { return HalfError(v); }
+    };
+
+    // Signed normalized: [-1, 1] to [-32767, 32767].  A three-component value like a
+    // normal goes in Snorm16x4 with w zero, or Snorm8x4 when 8 bits will do.
+    struct Snorm16x2
+    {
+        using Storage = DirectX::PackedVector::XMSHORTN2;
+        static const UINT Components = 2;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R16G16_SNORM;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::PackedVector::XMStoreShortN2(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::PackedVector::XMLoadShortN2(static_cast<const Storage*>(src)); }
+        static float MaxError(float v) { return SnormError(v, 32767.0f); }
+    };
+
+    struct Snorm16x4
+    {
+        using Storage = DirectX::PackedVector::XMSHORTN4;
+        static const UINT Components = 4;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R16G16B16A16_SNORM;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::PackedVector::XMStoreShortN4(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::PackedVector::XMLoadShortN4(static_cast<const Storage*>(src)); }
+        static float MaxError(float v) { return SnormError(v, 32767.0f); }
+    };
+
+    struct Snorm8x4
+    {
+        using Storage = DirectX::PackedVector::XMBYTEN4;
+        static const UINT Components = 4;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R8G8B8A8_SNORM;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::PackedVector::XMStoreByteN4(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::PackedVector::XMLoadByteN4(static_cast<const Storage*>(src)); }
+        static float MaxError(float v) { return SnormError(v, 127.0f); }
+    };
+
+    // Unsigned normalized: [0, 1] to [0, 255], for colors.
+    struct Unorm8x4
+    {
+        using Storage = DirectX::PackedVector::XMUBYTEN4;
+        static const UINT Components = 4;
+        static const DXGI_FORMAT Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        static void Encode(DirectX::FXMVECTOR v, void* dest) { DirectX::PackedVector::XMStoreUByteN4(static_cast<Storage*>(dest), v); }
+        static DirectX::XMVECTOR Decode(const void* src) { return DirectX::PackedVector::XMLoadUByteN4(static_cast<const Storage*>(src)); }
+        static float MaxError(float v) { return UnormError(v, 255.0f); }
+    };
+
+    template<class SemanticType, class EncodingType, UINT SemanticIndexValue = 0>
+    struct Element
+    {
+        using Semantic = SemanticType;
+        using Encoding = EncodingType;
+        static const UINT SemanticIndex = SemanticIndexValue;
+        static const UINT ByteSize = sizeof(typename EncodingType::Storage);
+    };
+
+    namespace Detail
+    {
+        template<UINT... Values>
+        struct Sum
+        {
+            static const UINT Value = 0;
+        };
+
+        template<UINT First, UINT... Rest>
+        struct Sum<First, Rest...>
+        {
+            static const UINT Value = First + Sum<Rest...>::Value;
+        };
+
+        // Encodes the elements of one vertex, the first at byte Offset.
+        template<UINT Offset, class... Elements>
+        struct EncodeElements
+        {
+            template<class Source>
+            static void Run(const Source&, const ConvertContext&, unsigned char*) {}
+        };
+
+        template<UINT Offset, class First, class... Rest>
+        struct EncodeElements<Offset, First, Rest...>
+        {
+            template<class Source>
+            static void Run(const Source& src, const ConvertContext& context, unsigned char* dest)
+            {
+                First::Encoding::Encode(First::Semantic::Load(src, context), dest + Offset);
+                EncodeElements<Offset + First::ByteSize, Rest...>::Run(src, context, dest);
+            }
+        };
+
+        // Checks the elements of one vertex, the first at byte Offset, against
+        // MaxError.  The float math of the unpack gets a few ulps on top.
+        template<UINT Offset, class... Elements>
+        struct VerifyElements
+        {
+            template<class Source>
+            static bool Run(const Source&, const ConvertContext&, const unsigned char*) { return true; }
+        };
+
+        template<UINT Offset, class First, class... Rest>
+        struct VerifyElements<Offset, First, Rest...>
+        {
+            template<class Source>
+            static bool Run(const Source& src, const ConvertContext& context, const unsigned char* stored)
+            {
+                DirectX::XMFLOAT4 expected, actual;
+                DirectX::XMStoreFloat4(&expected, First::Semantic::Load(src, context));
+                DirectX::XMStoreFloat4(&actual, First::Encoding::Decode(stored + Offset));
+
+                const float* e = &expected.x;
+                const float* a = &actual.x;
+                for(UINT i = 0; i < First::Encoding::Components; ++i)
+                {
+                    float slack = 4.0f*FLT_EPSILON*(1.0f + std::fabs(e[i]));
+                    if(!(std::fabs(a[i] - e[i]) <= First::Encoding::MaxError(e[i]) + slack))
+                        return false;
+                }
+
+                return VerifyElements<Offset + First::ByteSize, Rest...>::Run(src, context, stored);
+            }
+        };
+
+        template<class E>
+        D3D12_INPUT_ELEMENT_DESC Describe(UINT inputSlot, UINT& offset)
+        {
+            D3D12_INPUT_ELEMENT_DESC desc = { E::Semantic::Name(), E::SemanticIndex, E::Encoding::Format, inputSlot, offset,
+                                              D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 };
+            offset += E::ByteSize;
+            return desc;
+        }
+    }
+
+    template<class... Elements>
+    struct Layout
+    {
+        static_assert(sizeof...(Elements) > 0, "A vertex format needs at least one element.");
+
+        static const UINT ElementCount = sizeof...(Elements);
+        static const UINT Stride = Detail::Sum<Elements::ByteSize...>::Value;
+
+        // Appends the elements, read from inputSlot, to layout; formats fed from
+        // several vertex buffers append one slot each.
+        static void AppendInputLayout(std::vector<D3D12_INPUT_ELEMENT_DESC>& layout, UINT inputSlot = 0)
+        {
+            UINT offset = 0;
+            D3D12_INPUT_ELEMENT_DESC descs[] = { Detail::Describe<Elements>(inputSlot, offset)... };
+            layout.insert(layout.end(), descs, descs + ElementCount);
+        }
+
+        static std::vector<D3D12_INPUT_ELEMENT_DESC> InputLayout(UINT inputSlot = 0)
+        {
+            std::vector<D3D12_INPUT_ELEMENT_DESC> layout;
+            AppendInputLayout(layout, inputSlot);
+            return layout;
+        }
+
+        // Writes count vertices converted from src to dest, Stride bytes apart.
+        template<class Source>
+        static void Convert(const Source* src, void* dest, std::size_t count,
+                            const ConvertContext& context = ConvertContext())
+        {
+            unsigned char* out = static_cast<unsigned char*>(dest);
+            for(std::size_t i = 0; i < count; ++i, out += Stride)
+                Detail::EncodeElements<0, Elements...>::Run(src[i], context, out);
+        }
+
+        // Whether the count vertices at dest, as Convert wrote them from src, are
+        // within every encoding's MaxError of the values it was given.  Through
+        // QuantizedPosition that bounds the position error by Extents/65534 per axis
+        // in Snorm16; through OctahedralNormal the error of each octahedral
+        // component, and so the direction, in the same way.
+        template<class Source>
+        static bool Verify(const Source* src, const void* dest, std::size_t count,
+                           const ConvertContext& context = ConvertContext())
+        {
+            const unsigned char* stored = static_cast<const unsigned char*>(dest);
+            for(std::size_t i = 0; i < count; ++i, stored += Stride)
+            {
+                if(!Detail::VerifyElements<0, Elements...>::Run(src[i], context, stored))
+                    return false;
+            }
+            return true;
+        }
+    };
+}
@@ -3,11 +3,19 @@
 #include "../Common/d3dUtil.h"
 #include "../Common/MathHelper.h"
 #include "../Common/UploadBuffer.h"
+#include "VertexLayouts.h"
+#include "Waves.h"
 
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+    // Bounds the object's PackedVertexLayout positions are relative to.
+    DirectX::XMFLOAT3 BoundsCenter = { 0.0f, 0.0f, 0.0f };
+    float BoundsPad0 = 0.0f;
+    DirectX::XMFLOAT3 BoundsExtents = { 1.0f, 1.0f, 1.0f };
+    float BoundsPad1 = 0.0f;
 };
 
 struct PassConstants
@@ -49,13 +57,24 @@ struct Vertex
 	DirectX::XMFLOAT2 TexC;
 };
 
+struct TreeSpriteVertex
+{
+    DirectX::XMFLOAT3 Pos;
+    DirectX::XMFLOAT2 Size;
+};
+
+static_assert(sizeof(Vertex) == VertexLayout::Stride, "Vertex does not match VertexLayout.");
+static_assert(sizeof(TreeSpriteVertex) == TreeSpriteLayout::Stride, "TreeSpriteVertex does not match TreeSpriteLayout.");
+static_assert(sizeof(WaterSurface::StaticVertex) == WaterStaticLayout::Stride, "StaticVertex does not match WaterStaticLayout.");
+static_assert(sizeof(WaterSurface::StreamVertex) == WaterStreamLayout::Stride, "StreamVertex does not match WaterStreamLayout.");
+
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
 struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount, UINT waveIndexCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -72,8 +91,12 @@ public:
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
 
     // We cannot update a dynamic vertex buffer until the GPU is done processing
-    // the commands that reference it.  So each frame needs their own.
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    // the commands that reference it.  So each frame needs their own.  Only the
+    // per-frame half of the wave vertices (height and normal) lives here.
+    std::unique_ptr<UploadBuffer<Waves::StreamVertex>> WavesVB = nullptr;
+
+    // The wave grid's triangle list for the LODs picked this frame.
+    std::unique_ptr<UploadBuffer<std::uint32_t>> WavesIB = nullptr;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
@@ -0,0 +1,177 @@
+//***************************************************************************************
+// MeshBatchBuilder.cpp
+//***************************************************************************************
+
+#include "MeshBatchBuilder.h"
+#include <algorithm>
+#include "../Common/TaskScheduler.h"
+
+namespace
+{
+    // Vertices or indices handled by one task.
+    const UINT BlockSize = 16384;
+
+    // Item k covers [offsets[k], offsets[k + 1]) of a concatenated range.  Calls
+    // func(k, first, last) with the item-relative part of [begin, end) in each item.
+    template<typename Func>
+    void ForEachItemRange(const std::vector<UINT>& offsets, UINT begin, UINT end, const Func& func)
+    {
+        std::size_t item = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+        while(begin < end)
+        {
+            UINT last = std::min(end, offsets[item + 1]);
+            if(last > begin)
+                func(item, begin - offsets[item], last - offsets[item]);
+
+            begin = last;
+            ++item;
+        }
+    }
+}
+
+MeshBatchBuilder::MeshBatchBuilder(TaskScheduler* scheduler)
+{
+    mScheduler = scheduler;
+}
+
+MeshBatchBuilder::~MeshBatchBuilder()
+{
+}
+
+void MeshBatchBuilder::Add(const std::string& name, const GeometryGenerator::MeshData& mesh)
+{
+    Entry entry;
+    entry.Name = name;
+    entry.Mesh = &mesh;
+    mMeshes.push_back(entry);
+}
+
+std::unique_ptr<MeshGeometry> MeshBatchBuilder::BuildGeometry(const std::string& name, ID3D12Device* device,
+                                                              ID3D12GraphicsCommandList* cmdList, UINT vertexStride,
+                                                              ConvertFunc convert)const
+{
+    std::size_t meshCount = mMeshes.size();
+
+    //
+    // Where each mesh goes in the concatenated buffers.
+    //
+
+    std::vector<UINT> vertexOffsets(meshCount + 1, 0);
+    std::vector<UINT> indexOffsets(meshCount + 1, 0);
+    bool use32BitIndices = false;
+    for(std::size_t i = 0; i < meshCount; ++i)
+    {
+        const GeometryGenerator::MeshData& mesh = *mMeshes[i].Mesh;
+        vertexOffsets[i + 1] = vertexOffsets[i] + (UINT)mesh.Vertices.size();
+        indexOffsets[i + 1] = indexOffsets[i] + (UINT)mesh.Indices32.size();
+
+        use32BitIndices = use32BitIndices || mesh.Vertices.size() > GeometryGenerator::MeshData::MaxVertices16;
+    }
+
+    UINT vertexCount = vertexOffsets[meshCount];
+    UINT indexCount = indexOffsets[meshCount];
+    UINT indexSize = use32BitIndices ? sizeof(std::uint32_t) : sizeof(std::uint16_t);
+
+    auto geo = std::make_unique<MeshGeometry>();
+    geo->Name = name;
+    geo->VertexByteStride = vertexStride;
+    geo->VertexBufferByteSize = vertexCount * vertexStride;
+    geo->IndexFormat = use32BitIndices ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+    geo->IndexBufferByteSize = indexCount * indexSize;
+
+    // Per-mesh bounds, for the DrawArgs and for formats that quantize positions.
+    std::vector<VertexFormat::ConvertContext> contexts(meshCount);
+    ParallelFor(mScheduler, 0, (int)meshCount, 1, [&](int i)
+    {
+        const std::vector<GeometryGenerator::Vertex>& meshVertices = mMeshes[i].Mesh->Vertices;
+        if(!meshVertices.empty())
+        {
+            DirectX::BoundingBox::CreateFromPoints(contexts[i].Bounds, meshVertices.size(),
+                                                   &meshVertices[0].Position, sizeof(GeometryGenerator::Vertex));
+        }
+    });
+
+    //
+    // Convert and copy straight into the system memory copies.
+    //
+
+    ThrowIfFailed(D3DCreateBlob(geo->VertexBufferByteSize, &geo->VertexBufferCPU));
+    ThrowIfFailed(D3DCreateBlob(geo->IndexBufferByteSize, &geo->IndexBufferCPU));
+
+    unsigned char* vertices = static_cast<unsigned char*>(geo->VertexBufferCPU->GetBufferPointer());
+    void* indices = geo->IndexBufferCPU->GetBufferPointer();
+
+    int vertexBlocks = (int)((vertexCount + BlockSize - 1) / BlockSize);
+    ParallelFor(mScheduler, 0, vertexBlocks, 1, [&](int block)
+    {
+        UINT begin = (UINT)block * BlockSize;
+        UINT end = std::min(vertexCount, begin + BlockSize);
+        ForEachItemRange(vertexOffsets, begin, end, [&](std::size_t mesh, UINT first, UINT last)
+        {
+            convert(&mMeshes[mesh].Mesh->Vertices[first], vertices + (std::size_t)(vertexOffsets[mesh] + first)*vertexStride,
+                    last - first, contexts[mesh]);
+        });
+    });
+
+    // Indices stay relative to their mesh; each is drawn with its own base vertex.
+    int indexBlocks = (int)((indexCount + BlockSize - 1) / BlockSize);
+    ParallelFor(mScheduler, 0, indexBlocks, 1, [&](int block)
+    {
+        UINT begin = (UINT)block * BlockSize;
+        UINT end = std::min(indexCount, begin + BlockSize);
+        ForEachItemRange(indexOffsets, begin, end, [&](std::size_t mesh, UINT first, UINT last)
+        {
+            const std::uint32_t* src = &mMeshes[mesh].Mesh->Indices32[first];
+            UINT offset = indexOffsets[mesh] + first;
+            if(use32BitIndices)
+            {
+                std::copy(src, src + (last - first), static_cast<std::uint32_t*>(indices) + offset);
+            }
+            else
+            {
+                std::uint16_t* dest = static_cast<std::uint16_t*>(indices) + offset;
+                for(UINT i = 0; i < last - first; ++i)
+                    dest[i] = static_cast<std::uint16_t>(src[i]);
+            }
+        });
+    });
+
+    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(device, cmdList,
+        vertices, geo->VertexBufferByteSize, geo->VertexBufferUploader);
+
+    geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(device, cmdList,
+        indices, geo->IndexBufferByteSize, geo->IndexBufferUploader);
+
+    for(std::size_t i = 0; i < meshCount; ++i)
+    {
+        SubmeshGeometry submesh;
+        submesh.IndexCount = indexOffsets[i + 1] - indexOffsets[i];
+        submesh.StartIndexLocation = indexOffsets[i];
+        submesh.BaseVertexLocation = (INT)vertexOffsets[i];
+        submesh.Bounds = contexts[i].Bounds;
+
+        geo->DrawArgs[mMeshes[i].Name] = submesh;
+    }
+
+    return geo;
+}
+
+bool MeshBatchBuilder::ValidateVertices(const MeshGeometry& geo, VerifyFunc verify)const
+{
+    const unsigned char* vertices = static_cast<const unsigned char*>(geo.VertexBufferCPU->GetBufferPointer());
+    for(const Entry& entry : mMeshes)
+    {
+        const SubmeshGeometry& submesh = geo.DrawArgs.at(entry.Name);
+
+        VertexFormat::ConvertContext context;
+        context.Bounds = submesh.Bounds;
+
+        const std::vector<GeometryGenerator::Vertex>& meshVertices = entry.Mesh->Vertices;
+        if(!meshVertices.empty() &&
+           !verify(&meshVertices[0], vertices + (std::size_t)submesh.BaseVertexLocation*geo.VertexByteStride,
+                   meshVertices.size(), context))
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,82 @@
+//***************************************************************************************
+// MeshBatchBuilder.h
+//
+// Packs any number of GeometryGenerator meshes into one MeshGeometry: a single vertex
+// buffer and index buffer, with a DrawArgs entry per mesh.  Offsets come from one
+// prefix sum over the mesh sizes, and the vertices are converted to the requested
+// vertex format straight into the preallocated buffer, in blocks spread over the
+// task scheduler, so the work is one pass over the data however many meshes there
+// are.  Each DrawArgs entry gets the bounding box of its mesh, which is also what
+// formats with quantized positions are stored relative to.
+//***************************************************************************************
+
+#ifndef MESHBATCHBUILDER_H
+#define MESHBATCHBUILDER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "../Common/d3dUtil.h"
+#include "../Common/GeometryGenerator.h"
+#include "../Common/VertexFormat.h"
+
+class TaskScheduler;
+
+class MeshBatchBuilder
+{
+public:
+    explicit MeshBatchBuilder(TaskScheduler* scheduler = nullptr);
+    MeshBatchBuilder(const MeshBatchBuilder& rhs) = delete;
+    MeshBatchBuilder& operator=(const MeshBatchBuilder& rhs) = delete;
+    ~MeshBatchBuilder();
+
+    // Adds mesh as DrawArgs[name].  Only a pointer is kept, so mesh must stay alive
+    // and unchanged until Build.
+    void Add(const std::string& name, const GeometryGenerator::MeshData& mesh);
+
+    // Builds the geometry with vertices in the format Layout (a
+    // VertexFormat::Layout) and records the uploads of its buffers on cmdList.  The
+    // index buffer is 16-bit when every mesh has at most 65536 vertices, since each
+    // mesh is drawn with its own base vertex, and 32-bit otherwise.  Debug builds
+    // check every converted vertex against the encodings' error bounds; the
+    // conversion itself is Layout::Convert, which the Benchmarks "packed" mode
+    // checks without a device.
+    template<class Layout>
+    std::unique_ptr<MeshGeometry> Build(const std::string& name, ID3D12Device* device,
+                                        ID3D12GraphicsCommandList* cmdList)const
+    {
+        auto geo = BuildGeometry(name, device, cmdList, Layout::Stride, &Layout::template Convert<GeometryGenerator::Vertex>);
+
+#if defined(DEBUG) || defined(_DEBUG)
+        assert(ValidateVertices(*geo, &Layout::template Verify<GeometryGenerator::Vertex>));
+#endif
+
+        return geo;
+    }
+
+private:
+    typedef void (*ConvertFunc)(const GeometryGenerator::Vertex* src, void* dest, std::size_t count,
+                                const VertexFormat::ConvertContext& context);
+
+    std::unique_ptr<MeshGeometry> BuildGeometry(const std::string& name, ID3D12Device* device,
+                                                ID3D12GraphicsCommandList* cmdList, UINT vertexStride,
+                                                ConvertFunc convert)const;
+
+    typedef bool (*VerifyFunc)(const GeometryGenerator::Vertex* src, const void* dest, std::size_t count,
+                               const VertexFormat::ConvertContext& context);
+
+    // Whether every mesh's vertices in geo's system memory copy pass verify, with
+    // the bounds of its DrawArgs entry.
+    bool ValidateVertices(const MeshGeometry& geo, VerifyFunc verify)const;
+
+    struct Entry
+    {
+        std::string Name;
+        const GeometryGenerator::MeshData* Mesh = nullptr;
+    };
+
+    TaskScheduler* mScheduler = nullptr;
+    std::vector<Entry> mMeshes;
+};
+
+#endif // MESHBATCHBUILDER_H
@@ -0,0 +1,530 @@
+//***************************************************************************************
+// Ocean.cpp
+//***************************************************************************************
+
+#include "Ocean.h"
+#include "SimdFloat.h"
+#include "../Common/TaskScheduler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    const float Gravity = 9.81f;
+    const double Pi = 3.14159265358979323846;
+
+    // Columns per FFT task; a strip of a 512 x 512 spectrum is 128 KB, which stays
+    // in L2 across all the butterfly passes.
+    const int FftStripCols = 32;
+
+    // Side of the square blocks the planes are transposed in.
+    const int TransposeBlockSize = 32;
+
+    // Grid points per task of the per-row passes.
+    const int PointsPerRowTask = 8192;
+
+    // SplitMix64; the spectrum is the same for a seed on every platform.
+    std::uint64_t NextRandom(std::uint64_t& state)
+    {
+        std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Two independent standard normal samples (Box-Muller).
+    void Gaussian(std::uint64_t& state, float& g0, float& g1)
+    {
+        // Uniform in (0, 1] and [0, 1).
+        double u0 = ((NextRandom(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+        double u1 = (NextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+
+        double r = std::sqrt(-2.0 * std::log(u0));
+        g0 = (float)(r * std::cos(2.0 * Pi * u1));
+        g1 = (float)(r * std::sin(2.0 * Pi * u1));
+    }
+
+    // (re, im) = (aRe, aIm)*(wRe, wIm).
+    void ComplexMul(Simd::Float aRe, Simd::Float aIm, Simd::Float wRe, Simd::Float wIm,
+                    Simd::Float& re, Simd::Float& im)
+    {
+        re = Simd::Sub(Simd::Mul(aRe, wRe), Simd::Mul(aIm, wIm));
+        im = Simd::Add(Simd::Mul(aRe, wIm), Simd::Mul(aIm, wRe));
+    }
+
+    // Signed wave number of FFT index k.
+    int WaveNumber(int k, int n)
+    {
+        return k < n/2 ? k : k - n;
+    }
+}
+
+Ocean::Ocean(int n, float patchSize, float windSpeed, const XMFLOAT2& windDirection, float amplitude,
+             TaskScheduler* scheduler, std::uint64_t seed)
+{
+    assert(n >= 16 && (n & (n - 1)) == 0);
+
+    mScheduler = scheduler;
+
+    mN = n;
+    mLog2N = 0;
+    while((1 << mLog2N) < n)
+        ++mLog2N;
+    mNumPoints = n + 1;
+
+    mPatchSize = patchSize;
+    mSpatialStep = patchSize / n;
+    mHalfWidth = 0.5f*patchSize;
+
+    mH0Re.assign(n*n, 0.0f);
+    mH0Im.assign(n*n, 0.0f);
+    mH0ConjRe.assign(n*n, 0.0f);
+    mH0ConjIm.assign(n*n, 0.0f);
+    mOmega.assign(n*n, 0.0f);
+
+    mSpectrumRe.assign(n*n, 0.0f);
+    mSpectrumIm.assign(n*n, 0.0f);
+    mTransposeRe.assign(n*n, 0.0f);
+    mTransposeIm.assign(n*n, 0.0f);
+
+    mTwiddleRe.resize(n/2);
+    mTwiddleIm.resize(n/2);
+    for(int k = 0; k < n/2; ++k)
+    {
+        double angle = 2.0 * Pi * k / n;
+        mTwiddleRe[k] = (float)std::cos(angle);
+        mTwiddleIm[k] = (float)std::sin(angle);
+    }
+
+    mBitReverse.resize(n);
+    for(int k = 0; k < n; ++k)
+    {
+        int r = 0;
+        for(int b = 0; b < mLog2N; ++b)
+            r |= ((k >> b) & 1) << (mLog2N - 1 - b);
+        mBitReverse[k] = r;
+    }
+
+    mHeights.assign(n*n, 0.0f);
+    mNormals.assign(n*n, XMFLOAT3(0.0f, 1.0f, 0.0f));
+    mTangentX.assign(n*n, XMFLOAT3(1.0f, 0.0f, 0.0f));
+
+    mTexU.resize(mNumPoints);
+    for(int j = 0; j < mNumPoints; ++j)
+        mTexU[j] = (float)j / n;
+
+    BuildSpectrum(windSpeed, windDirection, amplitude, seed);
+    Update(0.0f);
+}
+
+Ocean::~Ocean()
+{
+}
+
+int Ocean::RowCount()const
+{
+    return mNumPoints;
+}
+
+int Ocean::ColumnCount()const
+{
+    return mNumPoints;
+}
+
+int Ocean::VertexCount()const
+{
+    return mNumPoints*mNumPoints;
+}
+
+int Ocean::TriangleCount()const
+{
+    return 2*mN*mN;
+}
+
+float Ocean::Width()const
+{
+    return mPatchSize;
+}
+
+float Ocean::Depth()const
+{
+    return mPatchSize;
+}
+
+float Ocean::SpatialStep()const
+{
+    return mSpatialStep;
+}
+
+float Ocean::Time()const
+{
+    return mTime;
+}
+
+int Ocean::SampleIndex(int i)const
+{
+    int row = i / mNumPoints;
+    int col = i - row*mNumPoints;
+    return (row & (mN - 1))*mN + (col & (mN - 1));
+}
+
+XMFLOAT3 Ocean::Position(int i)const
+{
+    int row = i / mNumPoints;
+    int col = i - row*mNumPoints;
+
+    return XMFLOAT3(
+        -mHalfWidth + col*mSpatialStep,
+        mHeights[SampleIndex(i)],
+        mHalfWidth - row*mSpatialStep);
+}
+
+XMFLOAT3 Ocean::Normal(int i)const
+{
+    return mNormals[SampleIndex(i)];
+}
+
+XMFLOAT3 Ocean::TangentX(int i)const
+{
+    return mTangentX[SampleIndex(i)];
+}
+
+void Ocean::BuildSpectrum(float windSpeed, const XMFLOAT2& windDirection, float amplitude, std::uint64_t seed)
+{
+    int n = mN;
+
+    XMFLOAT2 wind;
+    XMStoreFloat2(&wind, XMVector2Normalize(XMLoadFloat2(&windDirection)));
+
+    // Largest wave a sustained wind can raise, and a much shorter length below
+    // which waves are suppressed since the grid cannot resolve them anyway.
+    float largest = windSpeed*windSpeed / Gravity;
+    float smallest = largest / 1000.0f;
+
+    std::uint64_t state = seed;
+    for(int i = 0; i < n; ++i)
+    {
+        for(int j = 0; j < n; ++j)
+        {
+            // Row i runs along -z, column j along +x.
+            float kx = (float)(2.0 * Pi * WaveNumber(j, n) / mPatchSize);
+            float kz = (float)(-2.0 * Pi * WaveNumber(i, n) / mPatchSize);
+            float k2 = kx*kx + kz*kz;
+
+            // Phillips spectrum: A exp(-1/(kL)^2) / k^4 |k^ . w^|^2.
+            float phillips = 0.0f;
+            if(k2 > 0.0f)
+            {
+                float cosine = (kx*wind.x + kz*wind.y) / std::sqrt(k2);
+                phillips = amplitude * std::exp(-1.0f / (k2*largest*largest)) / (k2*k2) *
+                    cosine*cosine * std::exp(-k2*smallest*smallest);
+            }
+
+            float g0, g1;
+            Gaussian(state, g0, g1);
+
+            float scale = std::sqrt(0.5f*phillips);
+            mH0Re[i*n + j] = g0*scale;
+            mH0Im[i*n + j] = g1*scale;
+
+            // Deep water dispersion.
+            mOmega[i*n + j] = std::sqrt(Gravity*std::sqrt(k2));
+        }
+    }
+
+    // Pairing h0(k) with conj(h0(-k)) keeps the spectrum Hermitian, so the heights
+    // come out real.
+    for(int i = 0; i < n; ++i)
+    {
+        for(int j = 0; j < n; ++j)
+        {
+            int mirror = ((n - i) & (n - 1))*n + ((n - j) & (n - 1));
+            mH0ConjRe[i*n + j] = mH0Re[mirror];
+            mH0ConjIm[i*n + j] = -mH0Im[mirror];
+        }
+    }
+}
+
+void Ocean::Update(float dt)
+{
+    mTime += dt;
+
+    int n = mN;
+    int rowsPerTask = std::max(1, PointsPerRowTask / n);
+
+    // h(k, t) = h0(k) exp(i w t) + conj(h0(-k)) exp(-i w t).
+    ParallelFor(mScheduler, 0, n, rowsPerTask, [this](int i)
+    {
+        EvaluateSpectrumRow(i);
+    });
+
+    // Transform down the columns, then down the columns of the transpose, which
+    // were the rows.  The last transpose only keeps the real part.
+    InverseFftColumns(mSpectrumRe, mSpectrumIm);
+
+    int blocks = std::max(1, n / TransposeBlockSize);
+    ParallelFor(mScheduler, 0, blocks, 1, [this, blocks](int blockRow)
+    {
+        for(int blockCol = 0; blockCol < blocks; ++blockCol)
+        {
+            TransposeBlock(mSpectrumRe.data(), mTransposeRe.data(), blockRow, blockCol);
+            TransposeBlock(mSpectrumIm.data(), mTransposeIm.data(), blockRow, blockCol);
+        }
+    });
+
+    InverseFftColumns(mTransposeRe, mTransposeIm);
+
+    ParallelFor(mScheduler, 0, blocks, 1, [this, blocks](int blockRow)
+    {
+        for(int blockCol = 0; blockCol < blocks; ++blockCol)
+            TransposeBlock(mTransposeRe.data(), mHeights.data(), blockRow, blockCol);
+    });
+
+    ParallelFor(mScheduler, 0, n, rowsPerTask, [this](int i)
+    {
+        ComputeNormalsRow(i);
+    });
+}
+
+void Ocean::EvaluateSpectrumRow(int i)
+{
+    int begin = i*mN;
+    int end = begin + mN;
+    for(int k = begin; k < end; ++k)
+    {
+        float c = std::cos(mOmega[k]*mTime);
+        float s = std::sin(mOmega[k]*mTime);
+
+        mSpectrumRe[k] = (mH0Re[k] + mH0ConjRe[k])*c + (mH0ConjIm[k] - mH0Im[k])*s;
+        mSpectrumIm[k] = (mH0Im[k] + mH0ConjIm[k])*c + (mH0Re[k] - mH0ConjRe[k])*s;
+    }
+}
+
+void Ocean::InverseFftColumns(Plane& re, Plane& im)
+{
+    int stripCols = std::min(FftStripCols, mN);
+    int strips = mN / stripCols;
+
+    ParallelFor(mScheduler, 0, strips, 1, [this, &re, &im, stripCols](int strip)
+    {
+        InverseFftColumns(re.data(), im.data(), strip*stripCols, (strip + 1)*stripCols);
+    });
+}
+
+void Ocean::InverseFftColumns(float* re, float* im, int colBegin, int colEnd)const
+{
+    int n = mN;
+
+    // Put the rows in bit reversed order so the butterflies can run in place.
+    for(int i = 0; i < n; ++i)
+    {
+        int r = mBitReverse[i];
+        if(r <= i)
+            continue;
+
+        for(int j = colBegin; j < colEnd; j += Simd::Width)
+        {
+            Simd::Float aRe = Simd::Load(&re[i*n + j]);
+            Simd::Float aIm = Simd::Load(&im[i*n + j]);
+            Simd::Store(&re[i*n + j], Simd::Load(&re[r*n + j]));
+            Simd::Store(&im[i*n + j], Simd::Load(&im[r*n + j]));
+            Simd::Store(&re[r*n + j], aRe);
+            Simd::Store(&im[r*n + j], aIm);
+        }
+    }
+
+    // A radix-2 pass combines pairs of half-size transforms: a' = a + w*b,
+    // b' = a - w*b, with the same twiddle w for every column of the row pair.  A
+    // radix-4 pass does two radix-2 passes in one sweep over the rows, so the planes
+    // go through the cache half as often.  An odd number of radix-2 passes starts
+    // with a single one.
+    int half = 1;
+    if(mLog2N & 1)
+    {
+        for(int base = 0; base < n; base += 2)
+        {
+            float* aRe = &re[base*n];
+            float* aIm = &im[base*n];
+            float* bRe = &re[(base + 1)*n];
+            float* bIm = &im[(base + 1)*n];
+
+            for(int j = colBegin; j < colEnd; j += Simd::Width)
+            {
+                Simd::Float yRe = Simd::Load(&aRe[j]);
+                Simd::Float yIm = Simd::Load(&aIm[j]);
+                Simd::Float xRe = Simd::Load(&bRe[j]);
+                Simd::Float xIm = Simd::Load(&bIm[j]);
+                Simd::Store(&aRe[j], Simd::Add(yRe, xRe));
+                Simd::Store(&aIm[j], Simd::Add(yIm, xIm));
+                Simd::Store(&bRe[j], Simd::Sub(yRe, xRe));
+                Simd::Store(&bIm[j], Simd::Sub(yIm, xIm));
+            }
+        }
+        half = 2;
+    }
+
+    for(; half < n; half *= 4)
+    {
+        // Rows base + k + q*half for q = 0..3.  The first radix-2 pass pairs rows 0
+        // with 1 and 2 with 3 under twiddle w1; the second pairs 0 with 2 under w2
+        // and 1 with 3 under the twiddle a quarter turn on, i*w2.
+        int stride1 = n / (2*half);
+        int stride2 = n / (4*half);
+        for(int base = 0; base < n; base += 4*half)
+        {
+            for(int k = 0; k < half; ++k)
+            {
+                Simd::Float w1Re = Simd::Set1(mTwiddleRe[k*stride1]);
+                Simd::Float w1Im = Simd::Set1(mTwiddleIm[k*stride1]);
+                Simd::Float w2Re = Simd::Set1(mTwiddleRe[k*stride2]);
+                Simd::Float w2Im = Simd::Set1(mTwiddleIm[k*stride2]);
+
+                float* rowRe[4];
+                float* rowIm[4];
+                for(int q = 0; q < 4; ++q)
+                {
+                    rowRe[q] = &re[(base + k + q*half)*n];
+                    rowIm[q] = &im[(base + k + q*half)*n];
+                }
+
+                for(int j = colBegin; j < colEnd; j += Simd::Width)
+                {
+                    Simd::Float t1Re, t1Im, t3Re, t3Im;
+                    ComplexMul(Simd::Load(&rowRe[1][j]), Simd::Load(&rowIm[1][j]), w1Re, w1Im, t1Re, t1Im);
+                    ComplexMul(Simd::Load(&rowRe[3][j]), Simd::Load(&rowIm[3][j]), w1Re, w1Im, t3Re, t3Im);
+
+                    Simd::Float x0Re = Simd::Load(&rowRe[0][j]);
+                    Simd::Float x0Im = Simd::Load(&rowIm[0][j]);
+                    Simd::Float x2Re = Simd::Load(&rowRe[2][j]);
+                    Simd::Float x2Im = Simd::Load(&rowIm[2][j]);
+
+                    Simd::Float y0Re = Simd::Add(x0Re, t1Re);
+                    Simd::Float y0Im = Simd::Add(x0Im, t1Im);
+                    Simd::Float y1Re = Simd::Sub(x0Re, t1Re);
+                    Simd::Float y1Im = Simd::Sub(x0Im, t1Im);
+
+                    // u = w2*(x2 + t3) and v = w2*(x2 - t3); i*v is (-vIm, vRe).
+                    Simd::Float uRe, uIm, vRe, vIm;
+                    ComplexMul(Simd::Add(x2Re, t3Re), Simd::Add(x2Im, t3Im), w2Re, w2Im, uRe, uIm);
+                    ComplexMul(Simd::Sub(x2Re, t3Re), Simd::Sub(x2Im, t3Im), w2Re, w2Im, vRe, vIm);
+
+                    Simd::Store(&rowRe[0][j], Simd::Add(y0Re, uRe));
+                    Simd::Store(&rowIm[0][j], Simd::Add(y0Im, uIm));
+                    Simd::Store(&rowRe[2][j], Simd::Sub(y0Re, uRe));
+                    Simd::Store(&rowIm[2][j], Simd::Sub(y0Im, uIm));
+                    Simd::Store(&rowRe[1][j], Simd::Sub(y1Re, vIm));
+                    Simd::Store(&rowIm[1][j], Simd::Add(y1Im, vRe));
+                    Simd::Store(&rowRe[3][j], Simd::Add(y1Re, vIm));
+                    Simd::Store(&rowIm[3][j], Simd::Sub(y1Im, vRe));
+                }
+            }
+        }
+    }
+}
+
+void Ocean::TransposeBlock(const float* src, float* dst, int blockRow, int blockCol)const
+{
+    int size = std::min(TransposeBlockSize, mN);
+    int rowBegin = blockRow*size;
+    int colBegin = blockCol*size;
+
+    for(int i = rowBegin; i < rowBegin + size; ++i)
+    {
+        for(int j = colBegin; j < colBegin + size; ++j)
+            dst[j*mN + i] = src[i*mN + j];
+    }
+}
+
+void Ocean::ComputeNormalsRow(int i)
+{
+    int mask = mN - 1;
+    const float* h = &mHeights[i*mN];
+    const float* above = &mHeights[((i - 1) & mask)*mN];
+    const float* below = &mHeights[((i + 1) & mask)*mN];
+
+    // Central differences like Waves, wrapping around the periodic patch.
+    for(int j = 0; j < mN; ++j)
+    {
+        float l = h[(j - 1) & mask];
+        float r = h[(j + 1) & mask];
+        float t = above[j];
+        float b = below[j];
+
+        XMVECTOR n = XMVector3Normalize(XMVectorSet(-r+l, 2.0f*mSpatialStep, b-t, 0.0f));
+        XMStoreFloat3(&mNormals[i*mN + j], n);
+
+        XMVECTOR T = XMVector3Normalize(XMVectorSet(2.0f*mSpatialStep, r-l, 0.0f, 0.0f));
+        XMStoreFloat3(&mTangentX[i*mN + j], T);
+    }
+}
+
+void Ocean::WriteVertices(Vertex* dest)const
+{
+    int rowsPerTask = std::max(1, PointsPerRowTask / mNumPoints);
+
+    ParallelFor(mScheduler, 0, mNumPoints, rowsPerTask, [this, dest](int i)
+    {
+        WriteVertexRow(dest, i);
+    });
+}
+
+void Ocean::WriteVertexRow(Vertex* dest, int i)const
+{
+    int mask = mN - 1;
+    const float* h = &mHeights[(i & mask)*mN];
+    const XMFLOAT3* normals = &mNormals[(i & mask)*mN];
+    Vertex* out = dest + i*mNumPoints;
+
+    float z = mHalfWidth - i*mSpatialStep;
+    float v = mTexU[i];
+
+    bool aligned = (reinterpret_cast<uintptr_t>(out) & 15) == 0;
+    for(int j = 0; j < mNumPoints; ++j)
+    {
+        int k = j & mask;
+        StoreVertex(out + j, -mHalfWidth + j*mSpatialStep, h[k], z, normals[k], mTexU[j], v, aligned);
+    }
+
+    _mm_sfence();
+}
+
+void Ocean::WriteStaticVertices(StaticVertex* dest)const
+{
+    for(int i = 0; i < mNumPoints; ++i)
+    {
+        float z = mHalfWidth - i*mSpatialStep;
+        for(int j = 0; j < mNumPoints; ++j)
+        {
+            StaticVertex& v = dest[i*mNumPoints + j];
+            v.PosXZ = XMFLOAT2(-mHalfWidth + j*mSpatialStep, z);
+            v.TexC = XMFLOAT2(mTexU[j], mTexU[i]);
+        }
+    }
+}
+
+void Ocean::WriteStreamVertices(StreamVertex* dest)const
+{
+    int rowsPerTask = std::max(1, PointsPerRowTask / mNumPoints);
+
+    ParallelFor(mScheduler, 0, mNumPoints, rowsPerTask, [this, dest](int i)
+    {
+        WriteStreamVertexRow(dest, i);
+    });
+}
+
+void Ocean::WriteStreamVertexRow(StreamVertex* dest, int i)const
+{
+    int mask = mN - 1;
+    const float* h = &mHeights[(i & mask)*mN];
+    const XMFLOAT3* normals = &mNormals[(i & mask)*mN];
+    StreamVertex* out = dest + i*mNumPoints;
+
+    for(int j = 0; j < mNumPoints; ++j)
+    {
+        int k = j & mask;
+        StoreStreamVertex(out + j, h[k], normals[k]);
+    }
+}
@@ -0,0 +1,121 @@
+//***************************************************************************************
+// Ocean.h
+//
+// Open ocean height field synthesized from a wave spectrum, after Tessendorf,
+// "Simulating Ocean Water".  Complex amplitudes are drawn once from the Phillips
+// spectrum; every Update advances their phases by the deep water dispersion relation
+// and an inverse 2D FFT turns them into heights.  The cost of an update is
+// O(N^2 log N) however rough the sea is, and the patch is periodic, so copies of it
+// tile without seams.
+//
+// The FFT runs down the columns of split real/imaginary planes in radix-4 passes
+// (and one radix-2 pass when log2 n is odd), so each butterfly combines whole rows
+// and vectorizes across columns; the second dimension is done the same way after a
+// blocked transpose.  Column strips and transpose blocks are spread over the task
+// scheduler.
+//***************************************************************************************
+
+#ifndef OCEAN_H
+#define OCEAN_H
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "../Common/AlignedAllocator.h"
+#include "WaterSurface.h"
+
+class TaskScheduler;
+
+class Ocean final : public WaterSurface
+{
+public:
+    // An n x n spectrum (n a power of two, at least 16) over a square patch
+    // patchSize wide.  The grid has n + 1 points a side: the last row and column
+    // repeat the first, so the edges of neighboring patches match exactly.
+    // amplitude scales the Phillips spectrum; windSpeed (m/s) sets the size of the
+    // largest waves, which travel along windDirection in the xz-plane.
+    Ocean(int n, float patchSize, float windSpeed, const DirectX::XMFLOAT2& windDirection, float amplitude,
+          TaskScheduler* scheduler = nullptr, std::uint64_t seed = 1);
+    Ocean(const Ocean& rhs) = delete;
+    Ocean& operator=(const Ocean& rhs) = delete;
+    ~Ocean();
+
+    int RowCount()const override;
+    int ColumnCount()const override;
+    int VertexCount()const override;
+    int TriangleCount()const override;
+    float Width()const override;
+    float Depth()const override;
+    float SpatialStep()const override;
+
+    DirectX::XMFLOAT3 Position(int i)const override;
+    DirectX::XMFLOAT3 Normal(int i)const override;
+    DirectX::XMFLOAT3 TangentX(int i)const override;
+
+    // Moves the surface dt seconds forward and recomputes heights and normals.
+    void Update(float dt) override;
+
+    // Seconds simulated since construction.
+    float Time()const;
+
+    void WriteVertices(Vertex* dest)const override;
+    void WriteStaticVertices(StaticVertex* dest)const override;
+    void WriteStreamVertices(StreamVertex* dest)const override;
+
+private:
+    using Plane = std::vector<float, AlignedAllocator<float, 32>>;
+
+    void BuildSpectrum(float windSpeed, const DirectX::XMFLOAT2& windDirection, float amplitude, std::uint64_t seed);
+    void EvaluateSpectrumRow(int i);
+    void InverseFftColumns(float* re, float* im, int colBegin, int colEnd)const;
+    void InverseFftColumns(Plane& re, Plane& im);
+    void TransposeBlock(const float* src, float* dst, int blockRow, int blockCol)const;
+    void ComputeNormalsRow(int i);
+    void WriteVertexRow(Vertex* dest, int i)const;
+    void WriteStreamVertexRow(StreamVertex* dest, int i)const;
+
+    // Index into the n x n planes of grid point i, wrapping the repeated edges.
+    int SampleIndex(int i)const;
+
+private:
+    TaskScheduler* mScheduler = nullptr;
+
+    int mN = 0;
+    int mLog2N = 0;
+    int mNumPoints = 0;     // mN + 1 grid points a side
+
+    float mPatchSize = 0.0f;
+    float mSpatialStep = 0.0f;
+    float mHalfWidth = 0.0f;
+    float mTime = 0.0f;
+
+    // h0(k) and conj(h0(-k)) for every wave vector, in FFT order (index k stands
+    // for wave number k for k < n/2 and k - n above), and the angular frequency of
+    // each wave vector.
+    Plane mH0Re;
+    Plane mH0Im;
+    Plane mH0ConjRe;
+    Plane mH0ConjIm;
+    Plane mOmega;
+
+    // Spectrum at the current time, transformed in place, and its transpose.
+    Plane mSpectrumRe;
+    Plane mSpectrumIm;
+    Plane mTransposeRe;
+    Plane mTransposeIm;
+
+    // exp(2*pi*i*k/n) for k < n/2, and the bit reversal permutation.
+    std::vector<float> mTwiddleRe;
+    std::vector<float> mTwiddleIm;
+    std::vector<int> mBitReverse;
+
+    Plane mHeights;
+    std::vector<DirectX::XMFLOAT3> mNormals;
+    std::vector<DirectX::XMFLOAT3> mTangentX;
+
+    // Texture coordinates of each column, and of each row: v runs from 0 at the
+    // first row to 1 at the last, the same as u along a row.
+    std::vector<float> mTexU;
+};
+
+#endif // OCEAN_H
@@ -35,6 +35,12 @@ cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
+
+	// Box the object's packed positions are stored relative to (PACKED_VERTEX).
+	float3 gBoundsCenter;
+	float  gBoundsPad0;
+	float3 gBoundsExtents;
+	float  gBoundsPad1;
 };
 
 // Constant data that varies per pass.
@@ -78,12 +84,44 @@ cbuffer cbMaterial : register(b2)
 	float4x4 gMatTransform;
 };
 
+// Inverse of the octahedral encoding in WaterSurface.h and VertexFormat.h: y is the
+// pole and the lower half of the octahedron is folded over the corners of the xz
+// square.
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e.x, 1.0f - abs(e.x) - abs(e.y), e.y);
+	if(n.y < 0.0f)
+		n.xz = (1.0f - abs(n.zx)) * (n.xz >= 0.0f ? 1.0f : -1.0f);
+	return normalize(n);
+}
+
+#ifdef WAVES_SPLIT_STREAM
+// Wave grid vertices come in two streams: a static one with the xz position and
+// texture coordinates, and a per-frame one with the height and the normal.
+struct VertexIn
+{
+	float2 PosXZ     : POSITION;
+	float2 TexC      : TEXCOORD;
+	float  Height    : HEIGHT;
+	float2 NormalOct : NORMAL;
+};
+#elif defined(PACKED_VERTEX)
+// PackedVertexLayout: the position relative to the object's bounds, the normal
+// octahedral encoded and half precision texture coordinates.
+struct VertexIn
+{
+	float4 PosQ      : POSITION;
+	float2 NormalOct : NORMAL;
+	float2 TexC      : TEXCOORD;
+};
+#else
 struct VertexIn
 {
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
 };
+#endif
 
 struct VertexOut
 {
@@ -96,13 +134,24 @@ struct VertexOut
 VertexOut VS(VertexIn vin)
 {
 	VertexOut vout = (VertexOut)0.0f;
+
+#ifdef WAVES_SPLIT_STREAM
+	float3 posL = float3(vin.PosXZ.x, vin.Height, vin.PosXZ.y);
+	float3 normalL = DecodeOctahedral(vin.NormalOct);
+#elif defined(PACKED_VERTEX)
+	float3 posL = gBoundsCenter + gBoundsExtents * vin.PosQ.xyz;
+	float3 normalL = DecodeOctahedral(vin.NormalOct);
+#else
+	float3 posL = vin.PosL;
+	float3 normalL = vin.NormalL;
+#endif
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), gWorld);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(normalL, (float3x3)gWorld);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
@@ -0,0 +1,275 @@
+//***************************************************************************************
+// SimdFloat.h
+//
+// Thin wrappers over SSE/AVX so the CPU water kernels can be written once.  When the
+// project is compiled with /arch:AVX (or -mavx) every operation works on 8 floats,
+// otherwise on 4.  Aligned loads/stores expect Simd::Alignment byte boundaries.
+//
+// Blocks of Width values can also be loaded from and stored to 16-bit storage, as
+// half floats or as fixed point with a scale.  Half conversions use F16C when the
+// compiler targets it (/arch:AVX2, -mf16c) and an SSE2 bit-twiddling version with
+// the same round-to-nearest-even results otherwise.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <immintrin.h>
+
+// MSVC has no F16C macro and allows the intrinsics under /arch:AVX2; GCC and Clang
+// only with -mf16c, which -mavx2 does not imply.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define SIMD_HAS_F16C 1
+#endif
+
+namespace Simd
+{
+    namespace Detail
+    {
+        // Four halves, zero-extended into 32-bit lanes, to floats.  After F. Giesen's
+        // half_to_float_fast: shift exponent and mantissa into place and rescale
+        // with one multiply, which also handles denormals; patch up inf and NaN.
+        inline __m128 HalfToFloat4(__m128i h)
+        {
+            const __m128i noSign = _mm_set1_epi32(0x7fff);
+            const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+            const __m128i wasInfNan = _mm_set1_epi32(0x7bff);
+            const __m128 infNanExp = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+            __m128i expMant = _mm_and_si128(noSign, h);
+            __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMant), 16);
+            __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)), magic);
+            __m128 infNan = _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(expMant, wasInfNan)), infNanExp);
+
+            return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infNan));
+        }
+
+        // Four floats to halves, rounded to nearest even, sign-extended into 32-bit
+        // lanes so that _mm_packs_epi32 keeps them intact.  After F. Giesen's
+        // float_to_half_SSE2.
+        inline __m128i FloatToHalf4(__m128 f)
+        {
+            const __m128i infinity = _mm_set1_epi32(255 << 23);
+            const __m128i halfMax = _mm_set1_epi32((127 + 16) << 23);
+            const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+            const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+            const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+            __m128 sign = _mm_and_ps(_mm_set1_ps(-0.0f), f);
+            __m128 absF = _mm_xor_ps(f, sign);
+            __m128i absBits = _mm_castps_si128(absF);
+
+            __m128i isNan = _mm_cmpgt_epi32(absBits, infinity);
+            __m128i isRegular = _mm_cmpgt_epi32(halfMax, absBits);
+            __m128i infOrNan = _mm_or_si128(_mm_and_si128(isNan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+            __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absBits);
+
+            // Subnormal results: let a float add do the rounding.
+            __m128 sub = _mm_add_ps(absF, _mm_castsi128_ps(subnormalMagic));
+            __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(sub), subnormalMagic);
+
+            // Normal results: rebias the exponent and round, ties to even.
+            __m128i mantOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31);
+            __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absBits, normalBias), mantOdd), 13);
+
+            __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+            __m128i joined = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infOrNan));
+
+            return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+        }
+
+        // Sign-extends the low or high four 16-bit lanes to 32 bits.
+        inline __m128i WidenLo16(__m128i v) { return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); }
+        inline __m128i WidenHi16(__m128i v) { return _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16); }
+
+        // Largest magnitude a 16-bit fixed point value can hold.
+        const float FixedMax = 32767.0f;
+    }
+
+#if defined(__AVX__)
+    typedef __m256 Float;
+
+    const int Width = 8;
+    const int Alignment = 32;
+
+    inline Float Load(const float* p) { return _mm256_load_ps(p); }
+    inline Float LoadU(const float* p) { return _mm256_loadu_ps(p); }
+    inline void Store(float* p, Float v) { _mm256_store_ps(p, v); }
+    inline void StoreU(float* p, Float v) { _mm256_storeu_ps(p, v); }
+    inline Float Set1(float f) { return _mm256_set1_ps(f); }
+    inline Float Zero() { return _mm256_setzero_ps(); }
+
+    inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    inline Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    inline Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+    inline Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    inline Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+    inline Float Abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+    // All bits set in lane k where bit k of bits is set.
+    inline Float MaskFromBits(unsigned bits)
+    {
+        __m128i b = _mm_set1_epi32((int)bits);
+        __m128i lo = _mm_setr_epi32(1, 2, 4, 8);
+        __m128i hi = _mm_setr_epi32(16, 32, 64, 128);
+        lo = _mm_cmpeq_epi32(_mm_and_si128(b, lo), lo);
+        hi = _mm_cmpeq_epi32(_mm_and_si128(b, hi), hi);
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_castsi128_ps(lo)), _mm_castsi128_ps(hi), 1);
+    }
+
+    // Lanes of a where mask is set, of b elsewhere.
+    inline Float Select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+
+    // Width 16-bit values in a 128-bit register.  The aligned loads and stores need
+    // 16-byte boundaries.
+    inline Float FromHalfBits(__m128i bits)
+    {
+#if defined(SIMD_HAS_F16C)
+        return _mm256_cvtph_ps(bits);
+#else
+        __m128i zero = _mm_setzero_si128();
+        __m128 lo = Detail::HalfToFloat4(_mm_unpacklo_epi16(bits, zero));
+        __m128 hi = Detail::HalfToFloat4(_mm_unpackhi_epi16(bits, zero));
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+#endif
+    }
+
+    inline __m128i ToHalfBits(Float v)
+    {
+#if defined(SIMD_HAS_F16C)
+        return _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+#else
+        return _mm_packs_epi32(
+            Detail::FloatToHalf4(_mm256_castps256_ps128(v)),
+            Detail::FloatToHalf4(_mm256_extractf128_ps(v, 1)));
+#endif
+    }
+
+    inline Float FromFixedBits(__m128i bits, Float scale)
+    {
+        __m128 lo = _mm_cvtepi32_ps(Detail::WidenLo16(bits));
+        __m128 hi = _mm_cvtepi32_ps(Detail::WidenHi16(bits));
+        return Mul(_mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1), scale);
+    }
+
+    inline __m128i ToFixedBits(Float v, Float invScale)
+    {
+        Float limit = Set1(Detail::FixedMax);
+        __m256i q = _mm256_cvtps_epi32(Min(Max(Mul(v, invScale), Sub(Zero(), limit)), limit));
+        return _mm_packs_epi32(_mm256_castsi256_si128(q), _mm256_extractf128_si256(q, 1));
+    }
+
+    inline __m128i LoadBits(const std::uint16_t* p) { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline __m128i LoadBitsU(const std::uint16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void StoreBits(std::uint16_t* p, __m128i bits) { _mm_store_si128(reinterpret_cast<__m128i*>(p), bits); }
+    inline void StoreBitsU(std::uint16_t* p, __m128i bits) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), bits); }
+#else
+    typedef __m128 Float;
+
+    const int Width = 4;
+    const int Alignment = 16;
+
+    inline Float Load(const float* p) { return _mm_load_ps(p); }
+    inline Float LoadU(const float* p) { return _mm_loadu_ps(p); }
+    inline void Store(float* p, Float v) { _mm_store_ps(p, v); }
+    inline void StoreU(float* p, Float v) { _mm_storeu_ps(p, v); }
+    inline Float Set1(float f) { return _mm_set1_ps(f); }
+    inline Float Zero() { return _mm_setzero_ps(); }
+
+    inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+    inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    inline Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+    inline Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+    inline Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+    inline Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+    inline Float Abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+    inline Float MaskFromBits(unsigned bits)
+    {
+        __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)bits), lanes), lanes));
+    }
+
+    inline Float Select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+    // Width values in the low 64 bits; any alignment will do.
+    inline Float FromHalfBits(__m128i bits)
+    {
+#if defined(SIMD_HAS_F16C)
+        return _mm_cvtph_ps(bits);
+#else
+        return Detail::HalfToFloat4(_mm_unpacklo_epi16(bits, _mm_setzero_si128()));
+#endif
+    }
+
+    inline __m128i ToHalfBits(Float v)
+    {
+#if defined(SIMD_HAS_F16C)
+        return _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+#else
+        return _mm_packs_epi32(Detail::FloatToHalf4(v), _mm_setzero_si128());
+#endif
+    }
+
+    inline Float FromFixedBits(__m128i bits, Float scale)
+    {
+        return Mul(_mm_cvtepi32_ps(Detail::WidenLo16(bits)), scale);
+    }
+
+    inline __m128i ToFixedBits(Float v, Float invScale)
+    {
+        Float limit = Set1(Detail::FixedMax);
+        __m128i q = _mm_cvtps_epi32(Min(Max(Mul(v, invScale), Sub(Zero(), limit)), limit));
+        return _mm_packs_epi32(q, _mm_setzero_si128());
+    }
+
+    inline __m128i LoadBits(const std::uint16_t* p) { return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)); }
+    inline __m128i LoadBitsU(const std::uint16_t* p) { return LoadBits(p); }
+    inline void StoreBits(std::uint16_t* p, __m128i bits) { _mm_storel_epi64(reinterpret_cast<__m128i*>(p), bits); }
+    inline void StoreBitsU(std::uint16_t* p, __m128i bits) { StoreBits(p, bits); }
+#endif
+
+    // Single values, with the same rounding as the block conversions.
+    inline float HalfToFloat(std::uint16_t h)
+    {
+        return _mm_cvtss_f32(Detail::HalfToFloat4(_mm_cvtsi32_si128(h)));
+    }
+
+    inline std::uint16_t FloatToHalf(float f)
+    {
+        return (std::uint16_t)_mm_cvtsi128_si32(Detail::FloatToHalf4(_mm_set_ss(f)));
+    }
+
+    inline float FixedToFloat(std::uint16_t q, float scale)
+    {
+        return (std::int16_t)q * scale;
+    }
+
+    inline std::uint16_t FloatToFixed(float f, float invScale)
+    {
+        float q = f*invScale;
+        q = q < -Detail::FixedMax ? -Detail::FixedMax : (q > Detail::FixedMax ? Detail::FixedMax : q);
+        return (std::uint16_t)(std::int16_t)_mm_cvtss_si32(_mm_set_ss(q));
+    }
+
+    // Largest of the lanes of v.
+    inline float ReduceMax(Float v)
+    {
+        alignas(32) float lanes[Width];
+        Store(lanes, v);
+
+        float m = lanes[0];
+        for(int k = 1; k < Width; ++k)
+            m = lanes[k] > m ? lanes[k] : m;
+        return m;
+    }
+
+    // Rounds count up to a whole number of SIMD lanes.
+    inline int RoundUp(int count)
+    {
+        return (count + Width - 1) & ~(Width - 1);
+    }
+}
@@ -0,0 +1,44 @@
+//***************************************************************************************
+// VertexLayouts.h
+//
+// The vertex formats the shapes app draws with, declared once with VertexFormat.
+// Kept apart from FrameResource.h so that code without a device, such as the
+// headless tests, can convert to them.
+//***************************************************************************************
+
+#pragma once
+
+#include "../Common/VertexFormat.h"
+
+// The vertex formats.  Input layouts, strides and the conversion from
+// GeometryGenerator vertices come from these declarations; the structs are for
+// code that fills vertices by hand and are checked against them in FrameResource.h.
+using VertexLayout = VertexFormat::Layout<
+    VertexFormat::Element<VertexFormat::Position, VertexFormat::Float3>,
+    VertexFormat::Element<VertexFormat::Normal, VertexFormat::Float3>,
+    VertexFormat::Element<VertexFormat::TexCoord, VertexFormat::Float2>>;
+
+// VertexLayout in 16 bytes instead of 32, for static meshes: the position
+// relative to the mesh's bounds in 16-bit normalized (w unused), the octahedral
+// normal in 16-bit normalized and half precision texture coordinates.  Positions
+// are within Extents/65534 of the original per axis, normals within about 0.004
+// degrees and texture coordinates within 1/2048 of their magnitude.  Needs the
+// bounds in ObjectConstants and the PACKED_VERTEX shader define.
+using PackedVertexLayout = VertexFormat::Layout<
+    VertexFormat::Element<VertexFormat::QuantizedPosition, VertexFormat::Snorm16x4>,
+    VertexFormat::Element<VertexFormat::OctahedralNormal, VertexFormat::Snorm16x2>,
+    VertexFormat::Element<VertexFormat::TexCoord, VertexFormat::Half2>>;
+
+using TreeSpriteLayout = VertexFormat::Layout<
+    VertexFormat::Element<VertexFormat::Position, VertexFormat::Float3>,
+    VertexFormat::Element<VertexFormat::Size, VertexFormat::Float2>>;
+
+// Water is drawn from two vertex buffers: WaterSurface::StaticVertex in slot 0 and
+// WaterSurface::StreamVertex in slot 1.
+using WaterStaticLayout = VertexFormat::Layout<
+    VertexFormat::Element<VertexFormat::Position, VertexFormat::Float2>,
+    VertexFormat::Element<VertexFormat::TexCoord, VertexFormat::Float2>>;
+
+using WaterStreamLayout = VertexFormat::Layout<
+    VertexFormat::Element<VertexFormat::Height, VertexFormat::Float1>,
+    VertexFormat::Element<VertexFormat::Normal, VertexFormat::Snorm16x2>>;
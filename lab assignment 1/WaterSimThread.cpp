@@ -0,0 +1,106 @@
+//***************************************************************************************
+// WaterSimThread.cpp
+//***************************************************************************************
+
+#include "WaterSimThread.h"
+#include <cassert>
+
+WaterSimThread::WaterSimThread(WaterSurface* surface, std::function<void(float dt)> step)
+    : mReady(2)
+{
+    mSurface = surface;
+    mStep = std::move(step);
+
+    // Every slot starts out with the current surface, so Latest has something to
+    // return before the first update finishes.
+    for(Frame& frame : mFrames)
+    {
+        frame.Vertices.resize(surface->VertexCount());
+        surface->WriteStreamVertices(frame.Vertices.data());
+    }
+
+    mThread = std::thread(&WaterSimThread::Run, this);
+}
+
+WaterSimThread::~WaterSimThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_one();
+
+    mThread.join();
+}
+
+void WaterSimThread::Submit(float dt)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPendingTime += dt;
+        ++mSubmitted;
+    }
+    mWake.notify_one();
+}
+
+const WaterSimThread::Frame& WaterSimThread::Latest()
+{
+    if(mReady.load() & FreshBit)
+        mFront = mReady.exchange(mFront) & IndexMask;
+
+    const Frame& frame = mFrames[mFront];
+
+#if defined(DEBUG) || defined(_DEBUG)
+    assert(frame.EndSequence == frame.Sequence);
+    assert(frame.Sequence >= mLastSequence);
+#endif
+    mLastSequence = frame.Sequence;
+
+    return frame;
+}
+
+void WaterSimThread::Flush()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mIdle.wait(lock, [this] { return mCompleted == mSubmitted; });
+}
+
+void WaterSimThread::Run()
+{
+    double time = 0.0;
+
+    for(;;)
+    {
+        float dt = 0.0f;
+        std::uint64_t sequence = 0;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [this] { return mStop || mSubmitted != mCompleted; });
+            if(mStop)
+                return;
+
+            dt = mPendingTime;
+            mPendingTime = 0.0f;
+            sequence = mSubmitted;
+        }
+
+        mStep(dt);
+        time += dt;
+
+        Frame& frame = mFrames[mBack];
+        frame.Sequence = sequence;
+        frame.Time = time;
+        mSurface->WriteStreamVertices(frame.Vertices.data());
+        frame.EndSequence = sequence;
+
+        // Publish the frame and take back whichever slot it replaces: the previous
+        // newest frame if the reader never took it, or the one the reader let go.
+        mBack = mReady.exchange(mBack | FreshBit) & IndexMask;
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mCompleted = sequence;
+        }
+        mIdle.notify_all();
+    }
+}
@@ -0,0 +1,92 @@
+//***************************************************************************************
+// WaterSimThread.h
+//
+// Runs a water simulation on a worker thread, a frame ahead of rendering.  The render
+// thread submits each frame's time step and takes the newest finished vertex stream;
+// it never waits for the simulation.
+//
+// Results go through a triple buffer: the worker writes one frame, the render thread
+// reads another, and the third holds the newest finished frame.  Publishing and
+// taking a frame swap slot indices with a single atomic exchange, so each side only
+// ever touches a slot nobody else is using and reads can never be torn.
+//***************************************************************************************
+
+#ifndef WATERSIMTHREAD_H
+#define WATERSIMTHREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "WaterSurface.h"
+
+class WaterSimThread
+{
+public:
+    struct Frame
+    {
+        // Number of simulation updates the frame reflects; 0 for the initial state.
+        std::uint64_t Sequence = 0;
+
+        // Total time submitted up to this frame.
+        double Time = 0.0;
+
+        std::vector<WaterSurface::StreamVertex> Vertices;
+
+        // Written after the vertices with the same value as Sequence; checked by
+        // Latest in debug builds to catch a frame read while it is being written.
+        std::uint64_t EndSequence = 0;
+    };
+
+    // step advances the simulation by dt seconds; it runs on the worker thread, after
+    // which surface is exported with WriteStreamVertices.  Nothing else may update
+    // the simulation or read surface while the worker is running.
+    WaterSimThread(WaterSurface* surface, std::function<void(float dt)> step);
+    WaterSimThread(const WaterSimThread& rhs) = delete;
+    WaterSimThread& operator=(const WaterSimThread& rhs) = delete;
+    ~WaterSimThread();
+
+    // Queues dt seconds of simulation.  Time submitted while the worker is busy is
+    // added up and simulated in one update.
+    void Submit(float dt);
+
+    // Newest finished frame.  Call from one thread only; the frame stays valid and
+    // unchanged until the next call.
+    const Frame& Latest();
+
+    // Blocks until everything submitted so far has been simulated and published.
+    void Flush();
+
+private:
+    void Run();
+
+private:
+    static const int FreshBit = 4;
+    static const int IndexMask = 3;
+
+    WaterSurface* mSurface = nullptr;
+    std::function<void(float dt)> mStep;
+
+    Frame mFrames[3];
+
+    // Slot of the newest finished frame, with FreshBit set until the reader takes it.
+    std::atomic<int> mReady;
+    int mBack = 1;    // worker only
+    int mFront = 0;   // reader only
+    std::uint64_t mLastSequence = 0;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mIdle;
+    float mPendingTime = 0.0f;
+    std::uint64_t mSubmitted = 0;
+    std::uint64_t mCompleted = 0;
+    bool mStop = false;
+
+    std::thread mThread;
+};
+
+#endif // WATERSIMTHREAD_H
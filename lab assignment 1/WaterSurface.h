@@ -0,0 +1,136 @@
+//***************************************************************************************
+// WaterSurface.h
+//
+// Interface shared by the CPU water height fields (the Waves simulation and the
+// spectral Ocean), so the app can draw either through the same vertex streams.  A
+// surface is a RowCount() x ColumnCount() grid of points SpatialStep() apart, row i
+// at z = d/2 - i*dx and column j at x = -w/2 + j*dx; only the heights change.
+//***************************************************************************************
+
+#ifndef WATERSURFACE_H
+#define WATERSURFACE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <immintrin.h>
+#include <DirectXMath.h>
+
+class WaterSurface
+{
+public:
+    // Vertex layout written by WriteVertices; matches the app's position, normal,
+    // texture coordinate vertex.
+    struct Vertex
+    {
+        DirectX::XMFLOAT3 Pos;
+        DirectX::XMFLOAT3 Normal;
+        DirectX::XMFLOAT2 TexC;
+    };
+
+    // The split vertex stream: xz and texture coordinates never change, so they are
+    // written once by WriteStaticVertices, and only the height and the normal,
+    // octahedral encoded as two snorm16 values, are written every frame.
+    struct StaticVertex
+    {
+        DirectX::XMFLOAT2 PosXZ;
+        DirectX::XMFLOAT2 TexC;
+    };
+
+    struct StreamVertex
+    {
+        float Height;
+        std::int16_t NormalOct[2];
+    };
+
+    virtual ~WaterSurface() = default;
+
+    virtual int RowCount()const = 0;
+    virtual int ColumnCount()const = 0;
+    virtual int VertexCount()const = 0;
+    virtual int TriangleCount()const = 0;
+    virtual float Width()const = 0;
+    virtual float Depth()const = 0;
+
+    // Distance between neighboring grid points.
+    virtual float SpatialStep()const = 0;
+
+    virtual DirectX::XMFLOAT3 Position(int i)const = 0;
+    virtual DirectX::XMFLOAT3 Normal(int i)const = 0;
+    virtual DirectX::XMFLOAT3 TangentX(int i)const = 0;
+
+    // Advances the surface by dt seconds.
+    virtual void Update(float dt) = 0;
+
+    // Write all VertexCount() vertices to dest.  dest of WriteVertices and
+    // WriteStaticVertices is typically mapped upload heap memory, so it is only
+    // written, never read.  WriteStreamVertices fills a WaterSimThread frame in
+    // ordinary memory, which the render thread reads soon after.
+    virtual void WriteVertices(Vertex* dest)const = 0;
+    virtual void WriteStaticVertices(StaticVertex* dest)const = 0;
+    virtual void WriteStreamVertices(StreamVertex* dest)const = 0;
+
+protected:
+    // Write-combined upload memory must never be read; whole vertices are assembled
+    // in registers and streamed out past the cache (when dest is 16-byte aligned).
+    // Callers issue _mm_sfence() once a batch is written.
+    static void StoreVertex(Vertex* dest, float x, float y, float z, const DirectX::XMFLOAT3& n,
+                            float u, float v, bool aligned)
+    {
+        static_assert(sizeof(Vertex) == 8*sizeof(float), "Vertex must be two 16-byte halves.");
+
+        __m128 lo = _mm_setr_ps(x, y, z, n.x);
+        __m128 hi = _mm_setr_ps(n.y, n.z, u, v);
+
+        float* p = reinterpret_cast<float*>(dest);
+        if(aligned)
+        {
+            _mm_stream_ps(p, lo);
+            _mm_stream_ps(p + 4, hi);
+        }
+        else
+        {
+            _mm_storeu_ps(p, lo);
+            _mm_storeu_ps(p + 4, hi);
+        }
+    }
+
+    // Plain stores: the render thread copies the frame out right after it is
+    // published, so streaming it past the cache would only evict the lines it is
+    // about to read.
+    static void StoreStreamVertex(StreamVertex* dest, float height, const DirectX::XMFLOAT3& n)
+    {
+        StreamVertex v;
+        v.Height = height;
+        EncodeOctahedral(n, v.NormalOct);
+        *dest = v;
+    }
+
+    static std::int16_t ToSnorm16(float v)
+    {
+        v = std::min(std::max(v, -1.0f), 1.0f) * 32767.0f;
+        return (std::int16_t)(v >= 0.0f ? v + 0.5f : v - 0.5f);
+    }
+
+    // Projects the unit vector n onto the octahedron |x|+|y|+|z| = 1 and flattens
+    // it to the xz-plane, folding the lower half (y < 0) over the corners.  y is the
+    // pole since water normals point up.  Decoded by DecodeOctahedral in Default.hlsl.
+    static void EncodeOctahedral(const DirectX::XMFLOAT3& n, std::int16_t out[2])
+    {
+        float invL1 = 1.0f / (std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z));
+        float u = n.x*invL1;
+        float v = n.z*invL1;
+        if(n.y < 0.0f)
+        {
+            float foldU = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            float foldV = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = foldU;
+            v = foldV;
+        }
+
+        out[0] = ToSnorm16(u);
+        out[1] = ToSnorm16(v);
+    }
+};
+
+#endif // WATERSURFACE_H
@@ -2,16 +2,221 @@
 // Waves.cpp by Frank Luna (C) 2011 All Rights Reserved.
 //***************************************************************************************
 
+// Deterministic mode promises the same heights on every machine, which only holds
+// if the compiler never fuses a*b + c into an FMA: whether it may depends on the
+// target instruction set.  Placed ahead of the includes so that the inline helpers
+// this file uses are covered too.
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
 #include "Waves.h"
-#include <ppl.h>
+#include "SimdFloat.h"
+#include "../Common/TaskScheduler.h"
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 
 using namespace DirectX;
 
-Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
+namespace
+{
+	// Rough per-core cache budgets used to size the update tiles.  The fused sweep
+	// keeps a window of about four rows of a tile column-strip hot in L1 while the
+	// whole tile is sized to stay resident in L2.
+	const int L1CacheBytes = 32 * 1024;
+	const int L2CacheBytes = 256 * 1024;
+
+	// Bytes touched per grid cell by one step: prev/curr height plus normal and tangent.
+	const int BytesPerCell = 2 * sizeof(float) + 2 * sizeof(XMFLOAT3);
+
+	// Tiles are also the unit of activity tracking, so they are capped in size to
+	// let calm regions of a large grid be skipped at a useful granularity.  The
+	// column cap matches the L1 strip width: each tile row is one contiguous run,
+	// and runs much shorter than a kilobyte defeat the hardware prefetcher once the
+	// grid no longer fits in cache.
+	const int MaxTileCols = 256;
+	const int MaxTileRows = 32;
+
+	// Vertices written per WriteVertices task.
+	const int VerticesPerExportTask = 8192;
+
+	// 64-bit FNV-1a, fed 32-bit words.
+	const std::uint64_t HashOffsetBasis = 14695981039346656037ull;
+	const std::uint64_t HashPrime = 1099511628211ull;
+
+	std::uint64_t HashWords(const float* words, int count, std::uint64_t hash)
+	{
+		for(int k = 0; k < count; ++k)
+		{
+			std::uint32_t bits;
+			std::memcpy(&bits, &words[k], sizeof(bits));
+			hash = (hash ^ bits) * HashPrime;
+		}
+		return hash;
+	}
+
+	// Same, for the 16-bit height planes.
+	std::uint64_t HashWords(const std::uint16_t* words, int count, std::uint64_t hash)
+	{
+		for(int k = 0; k < count; ++k)
+			hash = (hash ^ words[k]) * HashPrime;
+		return hash;
+	}
+
+	// Leads every snapshot; all fields little-endian as stored in memory.
+	struct SnapshotHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+		std::uint32_t Format;
+		std::int32_t Rows;
+		std::int32_t Cols;
+		float Accumulator;
+		std::uint64_t StepCount;
+
+		// Height of one quantization step.
+		float Scale;
+		std::uint32_t PayloadBytes;
+	};
+
+	const std::uint32_t SnapshotMagic = 0x53564157; // "WAVS"
+	const std::uint32_t SnapshotVersion = 1;
+
+	void WriteVarint(std::vector<std::uint8_t>& out, std::uint32_t v)
+	{
+		while(v >= 0x80)
+		{
+			out.push_back((std::uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((std::uint8_t)v);
+	}
+
+	bool ReadVarint(const std::uint8_t*& p, const std::uint8_t* end, std::uint32_t& v)
+	{
+		v = 0;
+		for(int shift = 0; shift < 35; shift += 7)
+		{
+			if(p == end)
+				return false;
+
+			std::uint8_t byte = *p++;
+			v |= (std::uint32_t)(byte & 0x7f) << shift;
+			if((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	// Maps small signed deltas to small unsigned values: 0, -1, 1, -2, ...
+	std::uint32_t ZigZag(std::int32_t v)
+	{
+		return ((std::uint32_t)v << 1) ^ (std::uint32_t)(v >> 31);
+	}
+
+	std::int32_t UnZigZag(std::uint32_t v)
+	{
+		return (std::int32_t)(v >> 1) ^ -(std::int32_t)(v & 1);
+	}
+
+	// Columns per task of the implicit column sweep.
+	const int ImplicitStripCols = 32;
+
+	// Factors of the Thomas algorithm for the count x count tridiagonal matrix with
+	// diag on the diagonal and off on both off-diagonals, so that each solve is a
+	// forward and a back substitution without divides:
+	//   forward: x[k] = (r[k] - off*x[k-1]) * inv[k]
+	//   back:    x[k] -= c[k] * x[k+1]
+	void BuildThomasFactors(int count, float off, float diag, std::vector<float>& c, std::vector<float>& inv)
+	{
+		c.resize(count);
+		inv.resize(count);
+		for(int k = 0; k < count; ++k)
+		{
+			inv[k] = 1.0f / (k == 0 ? diag : diag - off*c[k-1]);
+			c[k] = off*inv[k];
+		}
+	}
+
+	// Width of the absorbing sponge, and the fraction of each step's change of
+	// height it removes and of the height it relaxes toward zero, at full weight.
+	// Relaxing the height drains the water disturbances add, which would otherwise
+	// slowly raise the level of a grid that has no zero edge.
+	const int SpongeCells = 8;
+	const float SpongeDamping = 0.3f;
+	const float SpongeRelax = 0.02f;
+
+	// Fixed16 range until SetFixedPointRange is called.
+	const float DefaultFixedRange = 4.0f;
+
+	// How the explicit step loads and stores a SIMD block of heights in each storage
+	// mode.  Load and Store take the aligned blocks of a padded row, LoadU any column.
+	struct FloatCodec
+	{
+		typedef float Type;
+
+		Simd::Float Load(const float* p)const { return Simd::Load(p); }
+		Simd::Float LoadU(const float* p)const { return Simd::LoadU(p); }
+		void Store(float* p, Simd::Float v)const { Simd::Store(p, v); }
+	};
+
+	struct HalfCodec
+	{
+		typedef std::uint16_t Type;
+
+		Simd::Float Load(const std::uint16_t* p)const { return Simd::FromHalfBits(Simd::LoadBits(p)); }
+		Simd::Float LoadU(const std::uint16_t* p)const { return Simd::FromHalfBits(Simd::LoadBitsU(p)); }
+		void Store(std::uint16_t* p, Simd::Float v)const { Simd::StoreBits(p, Simd::ToHalfBits(v)); }
+	};
+
+	struct FixedCodec
+	{
+		typedef std::uint16_t Type;
+
+		FixedCodec(float scale, float invScale) : Scale(Simd::Set1(scale)), InvScale(Simd::Set1(invScale)) {}
+
+		Simd::Float Load(const std::uint16_t* p)const { return Simd::FromFixedBits(Simd::LoadBits(p), Scale); }
+		Simd::Float LoadU(const std::uint16_t* p)const { return Simd::FromFixedBits(Simd::LoadBitsU(p), Scale); }
+		void Store(std::uint16_t* p, Simd::Float v)const { Simd::StoreBits(p, Simd::ToFixedBits(v, InvScale)); }
+
+		Simd::Float Scale;
+		Simd::Float InvScale;
+	};
+
+	bool ImpulseLess(const Waves::Impulse& a, const Waves::Impulse& b)
+	{
+		if(a.Row != b.Row)
+			return a.Row < b.Row;
+		if(a.Col != b.Col)
+			return a.Col < b.Col;
+		if(a.Magnitude != b.Magnitude)
+			return a.Magnitude < b.Magnitude;
+		return a.Radius < b.Radius;
+	}
+}
+
+Waves::Waves(int m, int n, float dx, float dt, float speed, float damping, TaskScheduler* scheduler,
+             Solver solver, Storage storage)
 {
+    // The implicit sweeps work on float planes.
+    assert(solver == Solver::Explicit || storage == Storage::Float32);
+    if(solver == Solver::Implicit)
+        storage = Storage::Float32;
+
+    mScheduler = scheduler;
+    mSolver = solver;
+    mStorage = storage;
+
     mNumRows = m;
     mNumCols = n;
 
@@ -27,27 +232,54 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    mImplicitD = d;
+    mImplicitHalfE = 0.5f*e;
+
+    mAbsorbK = (speed*dt - dx) / (speed*dt + dx);
+
+    // Pad each row so the interior stencil can run whole SIMD blocks per row.
+    mRowPitch = Simd::RoundUp(n);
+
+    mObstaclePitch = (mRowPitch + 7)/8 + 2;
+    mObstacles.assign(m*mObstaclePitch, 0);
+
+    // Generate grid vertices in system memory.  Only the heights are simulated;
+    // positions in the xz-plane are reconstructed from the grid on demand.
+    if(storage == Storage::Float32)
+    {
+        mPrevSolution.assign(m*mRowPitch, 0.0f);
+        mCurrSolution.assign(m*mRowPitch, 0.0f);
+        mNormals.assign(m*n, XMFLOAT3(0.0f, 1.0f, 0.0f));
+        mTangentX.assign(m*n, XMFLOAT3(1.0f, 0.0f, 0.0f));
+    }
+    else
+    {
+        // Zero is all bits clear in both 16-bit formats.
+        mPrevCompact.assign(m*mRowPitch, 0);
+        mCurrCompact.assign(m*mRowPitch, 0);
+    }
+
+    mFixedScale = DefaultFixedRange / Simd::Detail::FixedMax;
+    mFixedInvScale = Simd::Detail::FixedMax / DefaultFixedRange;
 
-    // Generate grid vertices in system memory.
+    mHalfWidth = (n - 1)*dx*0.5f;
+    mHalfDepth = (m - 1)*dx*0.5f;
 
-    float halfWidth = (n - 1)*dx*0.5f;
-    float halfDepth = (m - 1)*dx*0.5f;
+    // Derive tex-coords from position by mapping [-w/2,w/2] --> [0,1].
+    mTexU.resize(n);
+    mTexV.resize(m);
+    for(int j = 0; j < n; ++j)
+        mTexU[j] = 0.5f + (-mHalfWidth + j*dx) / Width();
     for(int i = 0; i < m; ++i)
+        mTexV[i] = 0.5f - (mHalfDepth - i*dx) / Depth();
+
+    BuildTiles();
+
+    if(solver == Solver::Implicit)
     {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
-
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
+        BuildThomasFactors(n - 2, -mImplicitHalfE, d + e, mRowFactorC, mRowFactorInv);
+        BuildThomasFactors(m - 2, -mImplicitHalfE, d + e, mColFactorC, mColFactorInv);
+        mImplicitScratch.assign(m*mRowPitch, 0.0f);
     }
 }
 
@@ -85,88 +317,1542 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
-void Waves::Update(float dt)
+float Waves::SpatialStep()const
 {
-	static float t = 0;
+	return mSpatialStep;
+}
 
-	// Accumulate time.
-	t += dt;
+XMFLOAT3 Waves::Normal(int i)const
+{
+	if(mStorage == Storage::Float32)
+		return mNormals[i];
+
+	XMFLOAT3 normal, tangent;
+	ComputeCompactNormal(i / mNumCols, i % mNumCols, &normal, &tangent);
+	return normal;
+}
+
+XMFLOAT3 Waves::TangentX(int i)const
+{
+	if(mStorage == Storage::Float32)
+		return mTangentX[i];
+
+	XMFLOAT3 normal, tangent;
+	ComputeCompactNormal(i / mNumCols, i % mNumCols, &normal, &tangent);
+	return tangent;
+}
+
+void Waves::ComputeCompactNormal(int i, int j, XMFLOAT3* normal, XMFLOAT3* tangent)const
+{
+	// Boundary points keep the flat normal, as with Float32 storage.
+	if(i == 0 || i == mNumRows - 1 || j == 0 || j == mNumCols - 1)
+	{
+		*normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		*tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		return;
+	}
+
+	int k = i*mRowPitch + j;
+	float l = DecodeHeight(mCurrCompact[k-1]);
+	float r = DecodeHeight(mCurrCompact[k+1]);
+	float t = DecodeHeight(mCurrCompact[k-mRowPitch]);
+	float b = DecodeHeight(mCurrCompact[k+mRowPitch]);
+
+	XMStoreFloat3(normal, XMVector3Normalize(XMVectorSet(-r+l, 2.0f*mSpatialStep, b-t, 0.0f)));
+	XMStoreFloat3(tangent, XMVector3Normalize(XMVectorSet(2.0f*mSpatialStep, r-l, 0.0f, 0.0f)));
+}
+
+Waves::Storage Waves::HeightStorage()const
+{
+	return mStorage;
+}
+
+void Waves::SetFixedPointRange(float maxHeight)
+{
+	// Decode at the old scale before switching to the new one.
+	HeightPlane prev, curr;
+	if(mStorage == Storage::Fixed16)
+	{
+		prev.resize(mPrevCompact.size());
+		curr.resize(mCurrCompact.size());
+		DecodeHeights(false, 0, (int)prev.size(), prev.data());
+		DecodeHeights(true, 0, (int)curr.size(), curr.data());
+	}
+
+	mFixedScale = maxHeight / Simd::Detail::FixedMax;
+	mFixedInvScale = Simd::Detail::FixedMax / maxHeight;
+
+	if(mStorage == Storage::Fixed16)
+	{
+		EncodeHeights(false, 0, (int)prev.size(), prev.data());
+		EncodeHeights(true, 0, (int)curr.size(), curr.data());
+	}
+}
+
+std::size_t Waves::MemoryFootprint()const
+{
+	return
+		(mPrevSolution.capacity() + mCurrSolution.capacity() + mImplicitScratch.capacity())*sizeof(float) +
+		(mNormals.capacity() + mTangentX.capacity())*sizeof(XMFLOAT3) +
+		(mPrevCompact.capacity() + mCurrCompact.capacity())*sizeof(std::uint16_t) +
+		(mSpongeRow.capacity() + mSpongeCol.capacity())*sizeof(float) +
+		mObstacles.capacity();
+}
+
+void Waves::SetBoundary(Boundary boundary)
+{
+	assert(mSolver == Solver::Explicit || boundary == Boundary::Zero);
+	mBoundary = boundary;
+
+	if(boundary != Boundary::Absorbing || !mSpongeRow.empty())
+		return;
+
+	// Sponge weights rise from 0 at SpongeCells from the edge to 1 on the edge.  The
+	// ramp is quadratic so the sponge itself reflects little.
+	auto ramp = [](int k, int count)
+	{
+		int d = std::min(k, count - 1 - k);
+		float t = std::max(0.0f, (float)(SpongeCells - d) / SpongeCells);
+		return t*t;
+	};
+
+	mSpongeRow.resize(mNumRows);
+	for(int i = 0; i < mNumRows; ++i)
+		mSpongeRow[i] = ramp(i, mNumRows);
+
+	mSpongeCol.assign(mRowPitch, 0.0f);
+	for(int j = 0; j < mNumCols; ++j)
+		mSpongeCol[j] = ramp(j, mNumCols);
+}
+
+Waves::Boundary Waves::BoundaryMode()const
+{
+	return mBoundary;
+}
+
+void Waves::SetObstacle(int i, int j, bool solid)
+{
+	assert(mSolver == Solver::Explicit);
+	assert(i >= 0 && i < mNumRows && j >= 0 && j < mNumCols);
+
+	if(IsObstacle(i, j) == solid)
+		return;
+
+	std::uint8_t& byte = mObstacles[i*mObstaclePitch + ((j + 8) >> 3)];
+	std::uint8_t bit = (std::uint8_t)(1u << ((j + 8) & 7));
+	if(solid)
+	{
+		byte |= bit;
+		++mObstacleCount;
+
+		StoreHeight(false, i*mRowPitch + j, 0.0f);
+		StoreHeight(true, i*mRowPitch + j, 0.0f);
+	}
+	else
+	{
+		byte &= (std::uint8_t)~bit;
+		--mObstacleCount;
+	}
+}
+
+void Waves::SetObstacleRect(float minX, float minZ, float maxX, float maxZ, bool solid)
+{
+	// Column j is at x = -w/2 + j*dx and row i at z = d/2 - i*dx.
+	int j0 = std::max(0, (int)std::ceil((minX + mHalfWidth) / mSpatialStep));
+	int j1 = std::min(mNumCols - 1, (int)std::floor((maxX + mHalfWidth) / mSpatialStep));
+	int i0 = std::max(0, (int)std::ceil((mHalfDepth - maxZ) / mSpatialStep));
+	int i1 = std::min(mNumRows - 1, (int)std::floor((mHalfDepth - minZ) / mSpatialStep));
+
+	for(int i = i0; i <= i1; ++i)
+	{
+		for(int j = j0; j <= j1; ++j)
+			SetObstacle(i, j, solid);
+	}
+}
+
+bool Waves::IsObstacle(int i, int j)const
+{
+	return (ObstacleBits(i, j) & 1) != 0;
+}
+
+void Waves::ClearObstacles()
+{
+	std::fill(mObstacles.begin(), mObstacles.end(), (std::uint8_t)0);
+	mObstacleCount = 0;
+}
+
+unsigned Waves::ObstacleBits(int i, int j)const
+{
+	// Bits of cells j to j + Simd::Width - 1; j may be -1.
+	const std::uint8_t* row = &mObstacles[i*mObstaclePitch];
+	int bit = j + 8;
+	unsigned word = row[bit >> 3] | (row[(bit >> 3) + 1] << 8);
+	return (word >> (bit & 7)) & ((1u << Simd::Width) - 1);
+}
+
+float Waves::DecodeHeight(std::uint16_t q)const
+{
+	return mStorage == Storage::Half16 ? Simd::HalfToFloat(q) : Simd::FixedToFloat(q, mFixedScale);
+}
+
+std::uint16_t Waves::EncodeHeight(float h)const
+{
+	return mStorage == Storage::Half16 ? Simd::FloatToHalf(h) : Simd::FloatToFixed(h, mFixedInvScale);
+}
+
+void Waves::DecodeHeights(bool current, int k, int count, float* dest)const
+{
+	if(mStorage == Storage::Float32)
+	{
+		const HeightPlane& plane = current ? mCurrSolution : mPrevSolution;
+		std::memcpy(dest, &plane[k], count*sizeof(float));
+		return;
+	}
+
+	const std::uint16_t* src = &(current ? mCurrCompact : mPrevCompact)[k];
+
+	int j = 0;
+	if(mStorage == Storage::Half16)
+	{
+		for(; j + Simd::Width <= count; j += Simd::Width)
+			Simd::StoreU(dest + j, Simd::FromHalfBits(Simd::LoadBitsU(src + j)));
+	}
+	else
+	{
+		Simd::Float scale = Simd::Set1(mFixedScale);
+		for(; j + Simd::Width <= count; j += Simd::Width)
+			Simd::StoreU(dest + j, Simd::FromFixedBits(Simd::LoadBitsU(src + j), scale));
+	}
+
+	for(; j < count; ++j)
+		dest[j] = DecodeHeight(src[j]);
+}
+
+void Waves::EncodeHeights(bool current, int k, int count, const float* src)
+{
+	if(mStorage == Storage::Float32)
+	{
+		HeightPlane& plane = current ? mCurrSolution : mPrevSolution;
+		std::memcpy(&plane[k], src, count*sizeof(float));
+		return;
+	}
+
+	std::uint16_t* dest = &(current ? mCurrCompact : mPrevCompact)[k];
+
+	int j = 0;
+	if(mStorage == Storage::Half16)
+	{
+		for(; j + Simd::Width <= count; j += Simd::Width)
+			Simd::StoreBitsU(dest + j, Simd::ToHalfBits(Simd::LoadU(src + j)));
+	}
+	else
+	{
+		Simd::Float invScale = Simd::Set1(mFixedInvScale);
+		for(; j + Simd::Width <= count; j += Simd::Width)
+			Simd::StoreBitsU(dest + j, Simd::ToFixedBits(Simd::LoadU(src + j), invScale));
+	}
+
+	for(; j < count; ++j)
+		dest[j] = EncodeHeight(src[j]);
+}
+
+float Waves::LoadHeight(bool current, int k)const
+{
+	if(mStorage == Storage::Float32)
+		return (current ? mCurrSolution : mPrevSolution)[k];
+	return DecodeHeight((current ? mCurrCompact : mPrevCompact)[k]);
+}
+
+void Waves::StoreHeight(bool current, int k, float h)
+{
+	if(mStorage == Storage::Float32)
+		(current ? mCurrSolution : mPrevSolution)[k] = h;
+	else
+		(current ? mCurrCompact : mPrevCompact)[k] = EncodeHeight(h);
+}
+
+void Waves::AddHeight(int k, float delta)
+{
+	// Solid cells stay flat.
+	if(mObstacleCount > 0 && IsObstacle(k / mRowPitch, k % mRowPitch))
+		return;
+
+	StoreHeight(true, k, LoadHeight(true, k) + delta);
+}
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+void Waves::WriteVertices(Vertex* dest)const
+{
+	int rowsPerTask = std::max(1, VerticesPerExportTask / mNumCols);
+
+	ParallelFor(mScheduler, 0, mNumRows, rowsPerTask, [this, dest](int i)
+	{
+		WriteVertexRow(dest, i);
+	});
+}
+
+void Waves::WriteVertexRow(Vertex* dest, int i)const
+{
+	if(mStorage != Storage::Float32)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		Vertex* out = dest + i*mNumCols;
+		float z = mHalfDepth - i*mSpatialStep;
+		float v = mTexV[i];
+		bool aligned = (reinterpret_cast<uintptr_t>(out) & 15) == 0;
+
+		ForEachCompactVertex(i, [&](int j, float y, const XMFLOAT3& normal)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
-			}
+			StoreVertex(out + j, -mHalfWidth + j*mSpatialStep, y, z, normal, mTexU[j], v, aligned);
 		});
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+		_mm_sfence();
+		return;
+	}
+
+	const float* curr = &mCurrSolution[i*mRowPitch];
+	const float* prev = &mPrevSolution[i*mRowPitch];
+	const XMFLOAT3* normals = &mNormals[i*mNumCols];
+	Vertex* out = dest + i*mNumCols;
+
+	float z = mHalfDepth - i*mSpatialStep;
+	float v = mTexV[i];
+	float alpha = mInterpolate ? mAlpha : 1.0f;
+
+	bool aligned = (reinterpret_cast<uintptr_t>(out) & 15) == 0;
+	for(int j = 0; j < mNumCols; ++j)
+	{
+		float y = curr[j];
+		if(mInterpolate)
+			y = prev[j] + (y - prev[j])*alpha;
+
+		StoreVertex(out + j, -mHalfWidth + j*mSpatialStep, y, z, normals[j], mTexU[j], v, aligned);
+	}
+
+	// Make the streamed data visible before the task is reported finished.
+	_mm_sfence();
+}
+
+void Waves::WriteStaticVertices(StaticVertex* dest)const
+{
+	for(int i = 0; i < mNumRows; ++i)
+	{
+		float z = mHalfDepth - i*mSpatialStep;
+		for(int j = 0; j < mNumCols; ++j)
+		{
+			StaticVertex& v = dest[i*mNumCols + j];
+			v.PosXZ = XMFLOAT2(-mHalfWidth + j*mSpatialStep, z);
+			v.TexC = XMFLOAT2(mTexU[j], mTexV[i]);
+		}
+	}
+}
+
+void Waves::WriteStreamVertices(StreamVertex* dest)const
+{
+	int rowsPerTask = std::max(1, VerticesPerExportTask / mNumCols);
+
+	ParallelFor(mScheduler, 0, mNumRows, rowsPerTask, [this, dest](int i)
+	{
+		WriteStreamVertexRow(dest, i);
+	});
+}
 
-		t = 0.0f; // reset time
+void Waves::WriteStreamVertexRow(StreamVertex* dest, int i)const
+{
+	if(mStorage != Storage::Float32)
+	{
+		StreamVertex* out = dest + i*mNumCols;
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+		ForEachCompactVertex(i, [out](int j, float y, const XMFLOAT3& normal)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
-			}
+			StoreStreamVertex(out + j, y, normal);
 		});
+		return;
+	}
+
+	const float* curr = &mCurrSolution[i*mRowPitch];
+	const float* prev = &mPrevSolution[i*mRowPitch];
+	const XMFLOAT3* normals = &mNormals[i*mNumCols];
+	StreamVertex* out = dest + i*mNumCols;
+
+	float alpha = mInterpolate ? mAlpha : 1.0f;
+
+	for(int j = 0; j < mNumCols; ++j)
+	{
+		float y = curr[j];
+		if(mInterpolate)
+			y = prev[j] + (y - prev[j])*alpha;
+
+		StoreStreamVertex(out + j, y, normals[j]);
 	}
 }
 
-void Waves::Disturb(int i, int j, float magnitude)
+template<class Func>
+void Waves::ForEachCompactVertex(int i, const Func& func)const
 {
-	// Don't disturb boundaries.
-	assert(i > 1 && i < mNumRows-2);
-	assert(j > 1 && j < mNumCols-2);
+	// Rows i-1, i and i+1 of the current solution are decoded a chunk of columns at a
+	// time, with a column of margin on either side, and the normals of the chunk are
+	// computed like ComputeNormal, a SIMD block at a time.  func(j, height, normal)
+	// is then called for every column.
+	const int ChunkCols = 256;
+	alignas(32) float up[ChunkCols + 2*Simd::Width];
+	alignas(32) float h[ChunkCols + 2*Simd::Width];
+	alignas(32) float down[ChunkCols + 2*Simd::Width];
+	alignas(32) float prev[ChunkCols + 2*Simd::Width];
+	alignas(32) float nx[ChunkCols];
+	alignas(32) float ny[ChunkCols];
+	alignas(32) float nz[ChunkCols];
 
-	float halfMag = 0.5f*magnitude;
+	bool interiorRow = i > 0 && i < mNumRows - 1;
+	const Simd::Float twoDx = Simd::Set1(2.0f*mSpatialStep);
+	const Simd::Float twoDxSq = Simd::Mul(twoDx, twoDx);
+	const Simd::Float one = Simd::Set1(1.0f);
 
-	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	for(int j0 = 0; j0 < mNumCols; j0 += ChunkCols)
+	{
+		int count = std::min(ChunkCols, mNumCols - j0);
+
+		// Column j lands at index j - j0 + 1.  Columns beyond the grid border are
+		// zeroed, and the normals that read them are overwritten below anyway.
+		int c0 = std::max(j0 - 1, 0);
+		int c1 = std::min(j0 + count + 1, mNumCols);
+		int offset = c0 - (j0 - 1);
+		int blocks = Simd::RoundUp(count);
+
+		float* rows[] = { h, prev, up, down };
+		for(float* row : rows)
+			std::fill(row, row + blocks + 2, 0.0f);
+
+		DecodeHeights(true, i*mRowPitch + c0, c1 - c0, h + offset);
+		if(mInterpolate)
+			DecodeHeights(false, i*mRowPitch + c0, c1 - c0, prev + offset);
+		if(interiorRow)
+		{
+			DecodeHeights(true, (i-1)*mRowPitch + c0, c1 - c0, up + offset);
+			DecodeHeights(true, (i+1)*mRowPitch + c0, c1 - c0, down + offset);
+		}
+
+		for(int k = 0; k < blocks; k += Simd::Width)
+		{
+			Simd::Float x = Simd::Sub(Simd::LoadU(h + k), Simd::LoadU(h + k + 2));
+			Simd::Float z = Simd::Sub(Simd::LoadU(down + k + 1), Simd::LoadU(up + k + 1));
+			Simd::Float lenSq = Simd::Add(Simd::Add(Simd::Mul(x, x), Simd::Mul(z, z)), twoDxSq);
+			Simd::Float invLen = Simd::Div(one, Simd::Sqrt(lenSq));
+
+			Simd::Store(nx + k, Simd::Mul(x, invLen));
+			Simd::Store(ny + k, Simd::Mul(twoDx, invLen));
+			Simd::Store(nz + k, Simd::Mul(z, invLen));
+		}
+
+		// Boundary points keep the flat normal, as with Float32 storage.
+		if(!interiorRow)
+		{
+			std::fill(nx, nx + count, 0.0f);
+			std::fill(ny, ny + count, 1.0f);
+			std::fill(nz, nz + count, 0.0f);
+		}
+		if(j0 == 0)
+		{
+			nx[0] = 0.0f; ny[0] = 1.0f; nz[0] = 0.0f;
+		}
+		if(j0 + count == mNumCols)
+		{
+			nx[count-1] = 0.0f; ny[count-1] = 1.0f; nz[count-1] = 0.0f;
+		}
+
+		for(int k = 0; k < count; ++k)
+		{
+			float y = h[k+1];
+			if(mInterpolate)
+				y = prev[k+1] + (y - prev[k+1])*mAlpha;
+
+			func(j0 + k, y, XMFLOAT3(nx[k], ny[k], nz[k]));
+		}
+	}
+}
+
+void Waves::SetMaxSubsteps(int count)
+{
+	mMaxSubsteps = std::max(1, count);
+}
+
+void Waves::SetInterpolation(bool enable)
+{
+	mInterpolate = enable;
+	mAlpha = enable ? mAccumulator / mTimeStep : 1.0f;
+}
+
+int Waves::SubstepCount()const
+{
+	return mSubstepCount;
+}
+
+void Waves::Update(float dt)
+{
+	// Accumulate time.
+	mAccumulator += dt;
+
+	// Run as many fixed steps as the accumulated time covers, up to the cap.
+	mSubstepCount = 0;
+	while(mAccumulator >= mTimeStep && mSubstepCount < mMaxSubsteps)
+	{
+		Step();
+
+		mAccumulator -= mTimeStep;
+		++mSubstepCount;
+	}
+
+	// If we hit the cap the simulation cannot keep up; drop the whole steps we owe
+	// rather than letting the backlog grow every frame, but keep the remainder.
+	if(mAccumulator >= mTimeStep)
+		mAccumulator = std::fmod(mAccumulator, mTimeStep);
+
+	if(mInterpolate)
+		mAlpha = mAccumulator / mTimeStep;
+}
+
+void Waves::Step()
+{
+	++mStepCount;
+
+	ApplyImpulses();
+
+	if(mSolver == Solver::Implicit)
+		StepImplicit();
+	else
+		StepExplicit();
+
+	if(mDeterministic)
+		ComputeStateHash();
+}
+
+void Waves::StepExplicit()
+{
+	// A wave moves at most one cell per step, so only tiles that are awake or share
+	// an edge with an awake tile can change.  Every other tile is flat (both
+	// solutions are exactly zero) and stays flat.
+	mActiveTiles.clear();
+	for(int k = 0; k < (int)mTiles.size(); ++k)
+	{
+		if(IsTileActive(k))
+			mActiveTiles.push_back(k);
+	}
+
+	// Only update interior points; the boundary is filled in afterwards.  Each tile
+	// steps its heights and computes the normals of the new solution in the same
+	// sweep, while the rows it just wrote are still in cache.
+	ParallelFor(mScheduler, 0, (int)mActiveTiles.size(), 1, [this](int k)
+	{
+		UpdateTile(mTiles[mActiveTiles[k]]);
+	});
+
+	ApplyBoundary();
+
+	// Normals along tile edges depend on heights written by the neighboring
+	// tiles, so they are finished once every tile has been stepped.
+	if(mStorage == Storage::Float32)
+	{
+		ParallelFor(mScheduler, 0, (int)mActiveTiles.size(), 1, [this](int k)
+		{
+			ComputeTileEdgeNormals(mTiles[mActiveTiles[k]]);
+		});
+	}
+
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.
+	std::swap(mPrevSolution, mCurrSolution);
+	std::swap(mPrevCompact, mCurrCompact);
+
+	// Put tiles whose energy has died out to sleep.  A sleeping tile next to an
+	// awake one is still stepped, so it is only flattened once it drops out of the
+	// active set altogether; clearing the quiet leading edge of a wave each step
+	// would slowly eat its energy.
+	for(int k : mActiveTiles)
+		mTiles[k].Awake = mTiles[k].Magnitude >= mSleepThreshold;
+
+	ParallelFor(mScheduler, 0, (int)mActiveTiles.size(), 1, [this](int k)
+	{
+		int tile = mActiveTiles[k];
+		if(!IsTileActive(tile))
+			ClearTile(mTiles[tile]);
+	});
+}
+
+void Waves::StepImplicit()
+{
+	// Every cell depends on every other one after a single implicit step, so calm
+	// tiles cannot be skipped.
+	mActiveTiles.resize(mTiles.size());
+	for(int k = 0; k < (int)mTiles.size(); ++k)
+		mActiveTiles[k] = k;
+
+	// Right-hand side and row sweep, then the column sweep into the previous
+	// buffer, which becomes the current solution.
+	ParallelFor(mScheduler, 1, mNumRows - 1, 1, [this](int i)
+	{
+		ImplicitRow(i);
+	});
+
+	int strips = (mRowPitch + ImplicitStripCols - 1) / ImplicitStripCols;
+	ParallelFor(mScheduler, 0, strips, 1, [this](int k)
+	{
+		int colBegin = k*ImplicitStripCols;
+		ImplicitColumns(colBegin, std::min(colBegin + ImplicitStripCols, mRowPitch));
+	});
+
+	std::swap(mPrevSolution, mCurrSolution);
+
+	const float* heights = mCurrSolution.data();
+	ParallelFor(mScheduler, 1, mNumRows - 1, 1, [this, heights](int i)
+	{
+		ComputeNormalsRow(heights, i, 1, mNumCols - 1);
+	});
+}
+
+double Waves::ImplicitEnergy()const
+{
+	//
+	// With A = -L = Ax + Ay split into its row and column parts, the ADI step is
+	//
+	//   (d + e^2/(4d)*Ax*Ay)u+ + e/2*A(u+) = 4u + (d - 4)u- - e/2*A(2u + u-)
+	//
+	// Taking the dot product with u+ - u- shows that
+	//
+	//   E = 2|u+ - u|^2 + e/2*<A(u+ + u), u+ + u> + e^2/(8d)*(<Ax*Ay*u+, u+> + <Ax*Ay*u, u>)
+	//
+	// drops by (d - 2)|u+ - u-|^2 + e^2/(8d)*|u+ - u-|^2 in the Ax*Ay norm every step.
+	// Ax and Ay commute, so every term is a sum of squares for any e and the scheme
+	// cannot blow up.  Here u+ is the current solution and u the previous one.
+	//
+	const double e = 2.0*mImplicitHalfE;
+	const double k = e*e/(8.0*mImplicitD);
+
+	auto at = [this](const HeightPlane& u, int i, int j) -> double
+	{
+		return (i < 0 || i >= mNumRows || j < 0 || j >= mNumCols) ? 0.0 : u[i*mRowPitch + j];
+	};
+	auto sum = [this, &at](int i, int j)
+	{
+		return at(mCurrSolution, i, j) + at(mPrevSolution, i, j);
+	};
+
+	double kinetic = 0.0;
+	double potential = 0.0;
+	double cross = 0.0;
+	for(int i = 0; i < mNumRows; ++i)
+	{
+		for(int j = 0; j < mNumCols; ++j)
+		{
+			double v = at(mCurrSolution, i, j) - at(mPrevSolution, i, j);
+			double s = sum(i, j);
+			double dx = sum(i, j + 1) - s;
+			double dz = sum(i + 1, j) - s;
+			kinetic += v*v;
+			potential += dx*dx + dz*dz;
+
+			// Ax and Ay only act on the interior; the edge stays at zero.
+			if(i == 0 || i == mNumRows - 1 || j == 0 || j == mNumCols - 1)
+				continue;
+
+			for(const HeightPlane* u : { &mCurrSolution, &mPrevSolution })
+			{
+				double h = at(*u, i, j);
+				double ax = 2.0*h - at(*u, i, j - 1) - at(*u, i, j + 1);
+				double az = 2.0*h - at(*u, i - 1, j) - at(*u, i + 1, j);
+				cross += ax*az;
+			}
+		}
+	}
+
+	return 2.0*kinetic + 0.5*e*potential + k*cross;
+}
+
+void Waves::ApplyBoundary()
+{
+	// The interior has been stepped into the previous buffer, which holds the new
+	// solution until the swap; the current buffer still holds the old one.
+	if(mBoundary == Boundary::Zero)
+		return;
+
+	auto edge = [this](int b, int inner)
+	{
+		float h = LoadHeight(false, inner);
+		if(mBoundary == Boundary::Absorbing)
+			h = LoadHeight(true, inner) + mAbsorbK*(h - LoadHeight(true, b));
+		StoreHeight(false, b, h);
+	};
+
+	for(int i = 1; i < mNumRows - 1; ++i)
+	{
+		edge(i*mRowPitch, i*mRowPitch + 1);
+		edge(i*mRowPitch + mNumCols - 1, i*mRowPitch + mNumCols - 2);
+	}
+
+	// The corners take the edge columns just written.
+	for(int j = 0; j < mNumCols; ++j)
+	{
+		edge(j, mRowPitch + j);
+		edge((mNumRows - 1)*mRowPitch + j, (mNumRows - 2)*mRowPitch + j);
+	}
+
+	// Tiles computed the normals next to the edge with the edge still at zero.
+	if(mStorage == Storage::Float32)
+	{
+		const float* next = mPrevSolution.data();
+		ComputeNormalsRow(next, 1, 1, mNumCols - 1);
+		ComputeNormalsRow(next, mNumRows - 2, 1, mNumCols - 1);
+		for(int i = 2; i < mNumRows - 2; ++i)
+		{
+			ComputeNormal(next, i, 1);
+			ComputeNormal(next, i, mNumCols - 2);
+		}
+	}
+}
+
+void Waves::ImplicitRow(int i)
+{
+	//
+	// With the Laplacian averaged as (L(u+) + 2L(u) + L(u-))/4 the damped wave
+	// equation steps as
+	//
+	//   d*u+ - e/2*L(u+) = 4u + (damping*dt - 2)u- + e/2*(2L(u) + L(u-))
+	//
+	// with d and e as for the explicit constants.
+	//
+	const float* up       = &mCurrSolution[(i-1)*mRowPitch];
+	const float* curr     = &mCurrSolution[i*mRowPitch];
+	const float* down     = &mCurrSolution[(i+1)*mRowPitch];
+	const float* prevUp   = &mPrevSolution[(i-1)*mRowPitch];
+	const float* prev     = &mPrevSolution[i*mRowPitch];
+	const float* prevDown = &mPrevSolution[(i+1)*mRowPitch];
+	float* rhs = &mImplicitScratch[i*mRowPitch];
+
+	const Simd::Float four = Simd::Set1(4.0f);
+	const Simd::Float two = Simd::Set1(2.0f);
+	const Simd::Float kPrev = Simd::Set1(mImplicitD - 4.0f);
+	const Simd::Float halfE = Simd::Set1(mImplicitHalfE);
+
+	// Same aligned blocks over the padded row as UpdateRow.
+	for(int j = 0; j < mRowPitch; j += Simd::Width)
+	{
+		Simd::Float c = Simd::Load(curr + j);
+		Simd::Float p = Simd::Load(prev + j);
+
+		Simd::Float lapCurr = Simd::Sub(Simd::Add(Simd::Add(Simd::Add(
+			Simd::Load(down + j), Simd::Load(up + j)),
+			Simd::LoadU(curr + j + 1)), Simd::LoadU(curr + j - 1)),
+			Simd::Mul(four, c));
+		Simd::Float lapPrev = Simd::Sub(Simd::Add(Simd::Add(Simd::Add(
+			Simd::Load(prevDown + j), Simd::Load(prevUp + j)),
+			Simd::LoadU(prev + j + 1)), Simd::LoadU(prev + j - 1)),
+			Simd::Mul(four, p));
+
+		Simd::Float r = Simd::Add(Simd::Add(
+			Simd::Mul(four, c),
+			Simd::Mul(kPrev, p)),
+			Simd::Mul(halfE, Simd::Add(Simd::Mul(two, lapCurr), lapPrev)));
+
+		Simd::Store(rhs + j, r);
+	}
+
+	// Boundary and padding cells of the new solution stay zero.
+	rhs[0] = 0.0f;
+	for(int j = mNumCols - 1; j < mRowPitch; ++j)
+		rhs[j] = 0.0f;
+
+	// Solve (d - e/2*Lx)w = rhs along the interior of the row, in place.
+	const float off = -mImplicitHalfE;
+	float* x = rhs + 1;
+	int count = mNumCols - 2;
+
+	x[0] *= mRowFactorInv[0];
+	for(int k = 1; k < count; ++k)
+		x[k] = (x[k] - off*x[k-1]) * mRowFactorInv[k];
+	for(int k = count - 2; k >= 0; --k)
+		x[k] -= mRowFactorC[k] * x[k+1];
+}
+
+void Waves::ImplicitColumns(int colBegin, int colEnd)
+{
+	// Solve (d - e/2*Ly)u+ = d*w down the interior of every column of the strip.
+	// Neighboring columns are independent, so whole rows of the strip are swept at
+	// once, a SIMD block at a time.  Boundary and padding columns have w = 0 and
+	// come out zero.
+	const Simd::Float d = Simd::Set1(mImplicitD);
+	const Simd::Float off = Simd::Set1(-mImplicitHalfE);
+	int count = mNumRows - 2;
+
+	for(int k = 0; k < count; ++k)
+	{
+		const float* w = &mImplicitScratch[(k+1)*mRowPitch];
+		const float* above = &mPrevSolution[k*mRowPitch];
+		float* x = &mPrevSolution[(k+1)*mRowPitch];
+		const Simd::Float inv = Simd::Set1(mColFactorInv[k]);
+
+		for(int j = colBegin; j < colEnd; j += Simd::Width)
+		{
+			Simd::Float r = Simd::Mul(d, Simd::Load(w + j));
+			if(k > 0)
+				r = Simd::Sub(r, Simd::Mul(off, Simd::Load(above + j)));
+			Simd::Store(x + j, Simd::Mul(r, inv));
+		}
+	}
+
+	for(int k = count - 2; k >= 0; --k)
+	{
+		const float* below = &mPrevSolution[(k+2)*mRowPitch];
+		float* x = &mPrevSolution[(k+1)*mRowPitch];
+		const Simd::Float c = Simd::Set1(mColFactorC[k]);
+
+		for(int j = colBegin; j < colEnd; j += Simd::Width)
+			Simd::Store(x + j, Simd::Sub(Simd::Load(x + j), Simd::Mul(c, Simd::Load(below + j))));
+	}
+}
+
+void Waves::ComputeStateHash()
+{
+	// Rows are hashed in parallel and the row hashes combined in row order, so the
+	// hash does not depend on how the rows were scheduled.
+	int rowsPerTask = std::max(1, VerticesPerExportTask / mNumCols);
+
+	ParallelFor(mScheduler, 0, mNumRows, rowsPerTask, [this](int i)
+	{
+		std::uint64_t hash = HashOffsetBasis;
+		if(mStorage == Storage::Float32)
+		{
+			hash = HashWords(&mCurrSolution[i*mRowPitch], mNumCols, hash);
+			hash = HashWords(&mPrevSolution[i*mRowPitch], mNumCols, hash);
+		}
+		else
+		{
+			hash = HashWords(&mCurrCompact[i*mRowPitch], mNumCols, hash);
+			hash = HashWords(&mPrevCompact[i*mRowPitch], mNumCols, hash);
+		}
+		mRowHashes[i] = hash;
+	});
+
+	std::uint64_t hash = HashOffsetBasis;
+	for(std::uint64_t rowHash : mRowHashes)
+	{
+		hash = (hash ^ (rowHash & 0xffffffff)) * HashPrime;
+		hash = (hash ^ (rowHash >> 32)) * HashPrime;
+	}
+	mStateHash = hash;
+}
+
+void Waves::Disturb(int i, int j, float magnitude)
+{
+	// Don't disturb boundaries.
+	assert(i > 1 && i < mNumRows-2);
+	assert(j > 1 && j < mNumCols-2);
+
+	float halfMag = 0.5f*magnitude;
+
+	// Disturb the ijth vertex height and its neighbors.
+	AddHeight(i*mRowPitch+j,     magnitude);
+	AddHeight(i*mRowPitch+j+1,   halfMag);
+	AddHeight(i*mRowPitch+j-1,   halfMag);
+	AddHeight((i+1)*mRowPitch+j, halfMag);
+	AddHeight((i-1)*mRowPitch+j, halfMag);
+
+	// The cross may straddle a tile edge.
+	WakeCell(i, j);
+	WakeCell(i, j+1);
+	WakeCell(i, j-1);
+	WakeCell(i+1, j);
+	WakeCell(i-1, j);
+}
+
+void Waves::DisturbBatch(const Impulse* impulses, int count)
+{
+	std::lock_guard<std::mutex> lock(mImpulseMutex);
+	mPendingImpulses.insert(mPendingImpulses.end(), impulses, impulses + count);
+}
+
+void Waves::ApplyImpulses()
+{
+	{
+		std::lock_guard<std::mutex> lock(mImpulseMutex);
+		mImpulses.swap(mPendingImpulses);
+		mPendingImpulses.clear();
+	}
+
+	// Threads may submit in any order; sorted, the sum at each cell is always formed
+	// the same way.
+	if(mDeterministic)
+		std::sort(mImpulses.begin(), mImpulses.end(), ImpulseLess);
+
+	// Bin the impulses by the tiles they touch.  Bins keep submission order, so
+	// overlapping impulses always add up the same way.
+	for(int k = 0; k < (int)mImpulses.size(); ++k)
+	{
+		int r0, r1, c0, c1;
+		GetImpulseBounds(mImpulses[k], r0, r1, c0, c1);
+		if(r0 >= r1 || c0 >= c1)
+			continue;
+
+		int tr0 = std::min((r0 - 1) / mTileRows, mTileGridRows - 1);
+		int tr1 = std::min((r1 - 2) / mTileRows, mTileGridRows - 1);
+		int tc0 = c0 / mTileCols;
+		int tc1 = (c1 - 1) / mTileCols;
+
+		for(int tr = tr0; tr <= tr1; ++tr)
+		{
+			for(int tc = tc0; tc <= tc1; ++tc)
+			{
+				int tile = tr*mTileGridCols + tc;
+				if(mTileImpulses[tile].empty())
+					mSplatTiles.push_back(tile);
+
+				mTileImpulses[tile].push_back(k);
+				mTiles[tile].Awake = true;
+			}
+		}
+	}
+
+	// Each tile only writes its own cells, so the tiles can be splatted in parallel.
+	ParallelFor(mScheduler, 0, (int)mSplatTiles.size(), 1, [this](int k)
+	{
+		int index = mSplatTiles[k];
+		const Tile& tile = mTiles[index];
+
+		for(int impulse : mTileImpulses[index])
+		{
+			SplatImpulse(mImpulses[impulse],
+				tile.RowBegin, tile.RowEnd, tile.ColBegin, tile.ColEnd);
+		}
+
+		mTileImpulses[index].clear();
+	});
+
+	mSplatTiles.clear();
+	mImpulses.clear();
+}
+
+void Waves::GetImpulseBounds(const Impulse& impulse, int& rowBegin, int& rowEnd, int& colBegin, int& colEnd)const
+{
+	int r = impulse.Radius > 0.0f ? (int)std::ceil(impulse.Radius) : 1;
+
+	// Boundary points are never disturbed.
+	rowBegin = std::max(impulse.Row - r, 1);
+	rowEnd = std::min(impulse.Row + r + 1, mNumRows - 1);
+	colBegin = std::max(impulse.Col - r, 1);
+	colEnd = std::min(impulse.Col + r + 1, mNumCols - 1);
+}
+
+void Waves::SplatImpulse(const Impulse& impulse, int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	int r0, r1, c0, c1;
+	GetImpulseBounds(impulse, r0, r1, c0, c1);
+
+	r0 = std::max(r0, rowBegin);
+	r1 = std::min(r1, rowEnd);
+	c0 = std::max(c0, colBegin);
+	c1 = std::min(c1, colEnd);
+
+	if(impulse.Radius <= 0.0f)
+	{
+		// Same cross as Disturb().
+		float halfMag = 0.5f*impulse.Magnitude;
+		for(int i = r0; i < r1; ++i)
+		{
+			for(int j = c0; j < c1; ++j)
+			{
+				int d = std::abs(i - impulse.Row) + std::abs(j - impulse.Col);
+				if(d == 0)
+					AddHeight(i*mRowPitch + j, impulse.Magnitude);
+				else if(d == 1)
+					AddHeight(i*mRowPitch + j, halfMag);
+			}
+		}
+		return;
+	}
+
+	// Smooth (1 - d^2/r^2)^2 falloff.
+	float invRadiusSq = 1.0f / (impulse.Radius*impulse.Radius);
+	for(int i = r0; i < r1; ++i)
+	{
+		float di = (float)(i - impulse.Row);
+		for(int j = c0; j < c1; ++j)
+		{
+			float dj = (float)(j - impulse.Col);
+			float w = 1.0f - (di*di + dj*dj)*invRadiusSq;
+			if(w > 0.0f)
+				AddHeight(i*mRowPitch + j, impulse.Magnitude*w*w);
+		}
+	}
+}
+
+std::uint64_t Waves::StepCount()const
+{
+	return mStepCount;
+}
+
+void Waves::SetDeterministic(bool enable)
+{
+	mDeterministic = enable;
+	mRowHashes.assign(enable ? mNumRows : 0, 0);
+
+	mStateHash = 0;
+	if(enable)
+		ComputeStateHash();
+}
+
+std::uint64_t Waves::StateHash()const
+{
+	return mStateHash;
+}
+
+void Waves::SeedRandom(std::uint64_t seed)
+{
+	mRandomState = seed;
+}
+
+int Waves::RandomInt(int a, int b)
+{
+	return a + (int)(NextRandom() % (std::uint32_t)(b - a + 1));
+}
+
+float Waves::RandomFloat(float a, float b)
+{
+	// 24 random bits map exactly onto [0, 1) in float.
+	float f = (NextRandom() >> 8) * (1.0f / 16777216.0f);
+	return a + f*(b - a);
+}
+
+std::uint32_t Waves::NextRandom()
+{
+	// SplitMix64.
+	std::uint64_t z = (mRandomState += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	z = z ^ (z >> 31);
+	return (std::uint32_t)(z >> 32);
+}
+
+void Waves::SaveSnapshot(std::vector<std::uint8_t>& out, SnapshotFormat format)const
+{
+	SnapshotHeader header = {};
+	header.Magic = SnapshotMagic;
+	header.Version = SnapshotVersion;
+	header.Format = (std::uint32_t)format;
+	header.Rows = mNumRows;
+	header.Cols = mNumCols;
+	header.Accumulator = mAccumulator;
+	header.StepCount = mStepCount;
+	header.Scale = 1.0f;
+
+	std::size_t headerOffset = out.size();
+	out.resize(headerOffset + sizeof(SnapshotHeader));
+	std::size_t payloadOffset = out.size();
+
+	// The previous solution is stored first, then the current one; padding is not.
+	// Heights are always stored as floats, whatever the storage mode.
+	const bool planes[] = { false, true };
+	std::vector<float> row(mNumCols);
+
+	if(format == SnapshotFormat::Float32)
+	{
+		for(bool current : planes)
+		{
+			for(int i = 0; i < mNumRows; ++i)
+			{
+				DecodeHeights(current, i*mRowPitch, mNumCols, row.data());
+
+				const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(row.data());
+				out.insert(out.end(), bytes, bytes + mNumCols*sizeof(float));
+			}
+		}
+	}
+	else
+	{
+		float maxHeight = 0.0f;
+		for(bool current : planes)
+		{
+			for(int i = 0; i < mNumRows; ++i)
+			{
+				DecodeHeights(current, i*mRowPitch, mNumCols, row.data());
+				for(float h : row)
+					maxHeight = std::max(maxHeight, std::fabs(h));
+			}
+		}
+
+		if(maxHeight > 0.0f)
+			header.Scale = maxHeight / 32767.0f;
+
+		float invScale = 1.0f / header.Scale;
+		for(bool current : planes)
+		{
+			for(int i = 0; i < mNumRows; ++i)
+			{
+				DecodeHeights(current, i*mRowPitch, mNumCols, row.data());
+
+				std::int32_t last = 0;
+				for(int j = 0; j < mNumCols; ++j)
+				{
+					std::int32_t q = (std::int32_t)std::lround(row[j]*invScale);
+					WriteVarint(out, ZigZag(q - last));
+					last = q;
+				}
+			}
+		}
+	}
+
+	header.PayloadBytes = (std::uint32_t)(out.size() - payloadOffset);
+	std::memcpy(&out[headerOffset], &header, sizeof(header));
+}
+
+bool Waves::RestoreSnapshot(const std::uint8_t* data, std::size_t size)
+{
+	SnapshotHeader header;
+	if(size < sizeof(header))
+		return false;
+
+	std::memcpy(&header, data, sizeof(header));
+	if(header.Magic != SnapshotMagic || header.Version != SnapshotVersion ||
+	   header.Rows != mNumRows || header.Cols != mNumCols ||
+	   header.PayloadBytes > size - sizeof(header))
+		return false;
+
+	const std::uint8_t* p = data + sizeof(header);
+	const std::uint8_t* end = p + header.PayloadBytes;
+
+	// Decode into fresh planes so that a bad snapshot changes nothing.
+	HeightPlane prev(mNumRows*mRowPitch, 0.0f);
+	HeightPlane curr(mNumRows*mRowPitch, 0.0f);
+	HeightPlane* planes[] = { &prev, &curr };
+
+	if(header.Format == (std::uint32_t)SnapshotFormat::Float32)
+	{
+		std::size_t rowBytes = mNumCols*sizeof(float);
+		if(header.PayloadBytes != 2*mNumRows*rowBytes)
+			return false;
+
+		for(HeightPlane* plane : planes)
+		{
+			for(int i = 0; i < mNumRows; ++i, p += rowBytes)
+				std::memcpy(&(*plane)[i*mRowPitch], p, rowBytes);
+		}
+	}
+	else if(header.Format == (std::uint32_t)SnapshotFormat::Quantized16)
+	{
+		for(HeightPlane* plane : planes)
+		{
+			for(int i = 0; i < mNumRows; ++i)
+			{
+				float* row = &(*plane)[i*mRowPitch];
+
+				// Every value the writer stores fits in 16 bits; one that leaves that
+				// range is a corrupt snapshot, and the 64-bit sum cannot overflow first.
+				std::int64_t q = 0;
+				for(int j = 0; j < mNumCols; ++j)
+				{
+					std::uint32_t delta;
+					if(!ReadVarint(p, end, delta))
+						return false;
+
+					q += UnZigZag(delta);
+					if(q < INT16_MIN || q > INT16_MAX)
+						return false;
+
+					row[j] = (float)q*header.Scale;
+				}
+			}
+		}
+
+		if(p != end)
+			return false;
+	}
+	else
+	{
+		return false;
+	}
+
+	if(mStorage == Storage::Float32)
+	{
+		mPrevSolution.swap(prev);
+		mCurrSolution.swap(curr);
+	}
+	else
+	{
+		EncodeHeights(false, 0, (int)prev.size(), prev.data());
+		EncodeHeights(true, 0, (int)curr.size(), curr.data());
+	}
+
+	mAccumulator = header.Accumulator;
+	mStepCount = header.StepCount;
+
+	if(mInterpolate)
+		mAlpha = mAccumulator / mTimeStep;
+
+	// Nothing is known about where the snapshot is calm; wake every tile and let
+	// the quiet ones go back to sleep after a step.
+	for(Tile& tile : mTiles)
+	{
+		tile.Awake = true;
+		tile.Magnitude = std::numeric_limits<float>::max();
+	}
+
+	if(mStorage == Storage::Float32)
+	{
+		for(int i = 1; i < mNumRows - 1; ++i)
+		{
+			for(int j = 1; j < mNumCols - 1; ++j)
+				ComputeNormal(mCurrSolution.data(), i, j);
+		}
+	}
+
+	if(mDeterministic)
+		ComputeStateHash();
+
+	return true;
+}
+
+void Waves::SetSleepThreshold(float epsilon)
+{
+	mSleepThreshold = epsilon;
+}
+
+int Waves::TileCount()const
+{
+	return (int)mTiles.size();
+}
+
+int Waves::ActiveTileCount()const
+{
+	return (int)mActiveTiles.size();
+}
+
+void Waves::BuildTiles()
+{
+	// Column strips are as wide as fits a window of four rows in L1, and tiles are as
+	// tall as keeps the whole tile in L2.  Strips are SIMD aligned in the padded row.
+	int stripCols = Simd::RoundUp(std::max(Simd::Width, L1CacheBytes / (4 * BytesPerCell)));
+	stripCols = std::min(std::min(stripCols, MaxTileCols), mRowPitch);
+
+	int tileRows = std::max(8, L2CacheBytes / (stripCols * BytesPerCell));
+	tileRows = std::min(tileRows, MaxTileRows);
+
+	mTileRows = tileRows;
+	mTileCols = stripCols;
+	mTileGridRows = (mNumRows - 2 + tileRows - 1) / tileRows;
+	mTileGridCols = (mRowPitch + stripCols - 1) / stripCols;
+
+	// Tiles are stored row-major in the tile grid.
+	mTiles.clear();
+	mTileImpulses.clear();
+	for(int r = 1; r < mNumRows - 1; r += tileRows)
+	{
+		for(int c = 0; c < mRowPitch; c += stripCols)
+		{
+			Tile tile;
+			tile.RowBegin = r;
+			tile.RowEnd = std::min(r + tileRows, mNumRows - 1);
+			tile.ColBegin = c;
+			tile.ColEnd = std::min(c + stripCols, mRowPitch);
+			mTiles.push_back(tile);
+		}
+	}
+
+	mTileImpulses.resize(mTiles.size());
+}
+
+bool Waves::IsTileActive(int k)const
+{
+	int tr = k / mTileGridCols;
+	int tc = k - tr*mTileGridCols;
+
+	return mTiles[k].Awake ||
+		(tr > 0 && mTiles[k - mTileGridCols].Awake) ||
+		(tr + 1 < mTileGridRows && mTiles[k + mTileGridCols].Awake) ||
+		(tc > 0 && mTiles[k - 1].Awake) ||
+		(tc + 1 < mTileGridCols && mTiles[k + 1].Awake);
+}
+
+void Waves::WakeCell(int i, int j)
+{
+	int tr = std::min((i - 1) / mTileRows, mTileGridRows - 1);
+	int tc = j / mTileCols;
+
+	mTiles[tr*mTileGridCols + tc].Awake = true;
+}
+
+void Waves::ClearTile(Tile& tile)
+{
+	if(tile.Magnitude == 0.0f)
+		return;
+
+	// Both solutions are below the threshold.  Flatten the tile completely so that
+	// skipping it from now on is exact.
+	int c0 = std::max(tile.ColBegin, 1);
+	int c1 = std::min(tile.ColEnd, mNumCols - 1);
+	for(int i = tile.RowBegin; i < tile.RowEnd; ++i)
+	{
+		if(mStorage != Storage::Float32)
+		{
+			std::fill(&mPrevCompact[i*mRowPitch + c0], &mPrevCompact[i*mRowPitch + c1], (std::uint16_t)0);
+			std::fill(&mCurrCompact[i*mRowPitch + c0], &mCurrCompact[i*mRowPitch + c1], (std::uint16_t)0);
+			continue;
+		}
+
+		std::fill(&mPrevSolution[i*mRowPitch + c0], &mPrevSolution[i*mRowPitch + c1], 0.0f);
+		std::fill(&mCurrSolution[i*mRowPitch + c0], &mCurrSolution[i*mRowPitch + c1], 0.0f);
+
+		for(int j = c0; j < c1; ++j)
+		{
+			mNormals[i*mNumCols + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			mTangentX[i*mNumCols + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		}
+	}
+
+	tile.Magnitude = 0.0f;
+}
+
+void Waves::GetTileNormalInterior(const Tile& tile, int& rowBegin, int& rowEnd, int& colBegin, int& colEnd)const
+{
+	// The normal at (i,j) reads the new heights of its four neighbors.  Neighbors that
+	// are boundary cells never change; any other neighbor outside the tile is written
+	// by another tile, so that cell is left to ComputeTileEdgeNormals.
+	rowBegin = tile.RowBegin == 1 ? 1 : tile.RowBegin + 1;
+	rowEnd = tile.RowEnd == mNumRows - 1 ? mNumRows - 1 : tile.RowEnd - 1;
+	colBegin = tile.ColBegin == 0 ? 1 : tile.ColBegin + 1;
+	colEnd = tile.ColEnd >= mNumCols - 1 ? mNumCols - 1 : tile.ColEnd - 1;
+}
+
+void Waves::UpdateTile(Tile& tile)
+{
+	// The new solution is written over the previous one.
+	const float* next = mPrevSolution.data();
+
+	int nr0, nr1, nc0, nc1;
+	GetTileNormalInterior(tile, nr0, nr1, nc0, nc1);
+
+	// Normals are only stored with Float32 storage.
+	bool normals = mStorage == Storage::Float32;
+
+	tile.Magnitude = 0.0f;
+	for(int i = tile.RowBegin; i < tile.RowEnd; ++i)
+	{
+		tile.Magnitude = std::max(tile.Magnitude, UpdateRow(i, tile.ColBegin, tile.ColEnd));
+
+		// Row i-1 now has all three of its new rows available.
+		if(normals && i - 1 >= nr0 && i - 1 < nr1)
+			ComputeNormalsRow(next, i - 1, nc0, nc1);
+	}
+
+	// The last row only needed the boundary row below it.
+	if(normals && tile.RowEnd - 1 >= nr0 && tile.RowEnd - 1 < nr1)
+		ComputeNormalsRow(next, tile.RowEnd - 1, nc0, nc1);
+}
+
+void Waves::ComputeTileEdgeNormals(const Tile& tile)
+{
+	const float* next = mPrevSolution.data();
+
+	int nr0, nr1, nc0, nc1;
+	GetTileNormalInterior(tile, nr0, nr1, nc0, nc1);
+
+	int c0 = std::max(tile.ColBegin, 1);
+	int c1 = std::min(tile.ColEnd, mNumCols - 1);
+
+	// A tile of nothing but the last edge column and row padding has no normals.
+	if(c0 >= c1)
+		return;
+
+	// Top and bottom rows of the tile.
+	if(nr0 > tile.RowBegin)
+		ComputeNormalsRow(next, tile.RowBegin, c0, c1);
+	if(nr1 < tile.RowEnd)
+		ComputeNormalsRow(next, tile.RowEnd - 1, c0, c1);
+
+	// Left and right columns in between.
+	for(int i = nr0; i < nr1; ++i)
+	{
+		if(nc0 > c0)
+			ComputeNormal(next, i, c0);
+		if(nc1 < c1)
+			ComputeNormal(next, i, c1 - 1);
+	}
+}
+
+void Waves::ComputeNormalsRow(const float* heights, int i, int colBegin, int colEnd)
+{
+	//
+	// Compute normals using finite difference scheme, several cells at a time.
+	//
+	const float* up   = heights + (i-1)*mRowPitch;
+	const float* h    = heights + i*mRowPitch;
+	const float* down = heights + (i+1)*mRowPitch;
+
+	XMFLOAT3* normals = &mNormals[i*mNumCols];
+	XMFLOAT3* tangents = &mTangentX[i*mNumCols];
+
+	const Simd::Float twoDx = Simd::Set1(2.0f*mSpatialStep);
+	const Simd::Float twoDxSq = Simd::Mul(twoDx, twoDx);
+
+	alignas(32) float nx[Simd::Width];
+	alignas(32) float nz[Simd::Width];
+	alignas(32) float invN[Simd::Width];
+	alignas(32) float ty[Simd::Width];
+	alignas(32) float invT[Simd::Width];
+
+	int j = colBegin;
+	for(; j + Simd::Width <= colEnd; j += Simd::Width)
+	{
+		Simd::Float l = Simd::LoadU(h + j - 1);
+		Simd::Float r = Simd::LoadU(h + j + 1);
+		Simd::Float t = Simd::LoadU(up + j);
+		Simd::Float b = Simd::LoadU(down + j);
+
+		// N = (l-r, 2dx, b-t), T = (2dx, r-l, 0).
+		Simd::Float x = Simd::Sub(l, r);
+		Simd::Float z = Simd::Sub(b, t);
+		Simd::Float xSq = Simd::Mul(x, x);
+
+		Simd::Float lenN = Simd::Sqrt(Simd::Add(Simd::Add(xSq, twoDxSq), Simd::Mul(z, z)));
+		Simd::Float lenT = Simd::Sqrt(Simd::Add(twoDxSq, xSq));
+
+		Simd::Store(nx, x);
+		Simd::Store(nz, z);
+		Simd::Store(invN, Simd::Div(Simd::Set1(1.0f), lenN));
+		Simd::Store(ty, Simd::Sub(r, l));
+		Simd::Store(invT, Simd::Div(Simd::Set1(1.0f), lenT));
+
+		for(int k = 0; k < Simd::Width; ++k)
+		{
+			float s = invN[k];
+			normals[j+k] = XMFLOAT3(nx[k]*s, 2.0f*mSpatialStep*s, nz[k]*s);
+
+			s = invT[k];
+			tangents[j+k] = XMFLOAT3(2.0f*mSpatialStep*s, ty[k]*s, 0.0f);
+		}
+	}
+
+	for(; j < colEnd; ++j)
+		ComputeNormal(heights, i, j);
+}
+
+void Waves::ComputeNormal(const float* heights, int i, int j)
+{
+	const float* h = heights + i*mRowPitch;
+	float l = h[j-1];
+	float r = h[j+1];
+	float t = h[j-mRowPitch];
+	float b = h[j+mRowPitch];
+
+	XMVECTOR n = XMVector3Normalize(XMVectorSet(-r+l, 2.0f*mSpatialStep, b-t, 0.0f));
+	XMStoreFloat3(&mNormals[i*mNumCols+j], n);
+
+	XMVECTOR T = XMVector3Normalize(XMVectorSet(2.0f*mSpatialStep, r-l, 0.0f, 0.0f));
+	XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+}
+
+float Waves::UpdateRow(int i, int colBegin, int colEnd)
+{
+	// The obstacle mask is only read when there are obstacles.
+	auto run = [&](const auto& codec, auto* prevPlane, const auto* currPlane)
+	{
+		if(mObstacleCount > 0)
+			return UpdateRow<true>(codec, prevPlane, currPlane, i, colBegin, colEnd);
+		return UpdateRow<false>(codec, prevPlane, currPlane, i, colBegin, colEnd);
+	};
+
+	switch(mStorage)
+	{
+	case Storage::Half16:
+		return run(HalfCodec(), mPrevCompact.data(), mCurrCompact.data());
+	case Storage::Fixed16:
+		return run(FixedCodec(mFixedScale, mFixedInvScale), mPrevCompact.data(), mCurrCompact.data());
+	default:
+		return run(FloatCodec(), mPrevSolution.data(), mCurrSolution.data());
+	}
+}
+
+template<bool Masked, class Codec>
+float Waves::UpdateRow(const Codec& codec, typename Codec::Type* prevPlane, const typename Codec::Type* currPlane,
+                       int i, int colBegin, int colEnd)
+{
+	// After this update we will be discarding the old previous
+	// buffer, so overwrite that buffer with the new update.
+	// Note how we can do this inplace (read/write to same element)
+	// because we won't need prev_ij again and the assignment happens last.
+
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+	// Moreover, our +z axis goes "down"; this is just to
+	// keep consistent with our row indices going down.
+
+	typedef typename Codec::Type Type;
+	const Type* up   = currPlane + (i-1)*mRowPitch;
+	const Type* curr = currPlane + i*mRowPitch;
+	const Type* down = currPlane + (i+1)*mRowPitch;
+	Type* prev = prevPlane + i*mRowPitch;
+
+	const Simd::Float k1 = Simd::Set1(mK1);
+	const Simd::Float k2 = Simd::Set1(mK2);
+	const Simd::Float k3 = Simd::Set1(mK3);
+
+	// Absorbing sponge: the change of each height over the step is damped and the
+	// new height pulled toward zero, in proportion to the sponge weight of the row
+	// plus that of the column.
+	const bool sponge = mBoundary == Boundary::Absorbing;
+	const Simd::Float rowSponge = Simd::Set1(sponge ? mSpongeRow[i] : 0.0f);
+	const Simd::Float spongeDamping = Simd::Set1(SpongeDamping);
+	const Simd::Float spongeRelax = Simd::Set1(SpongeRelax);
+	const Simd::Float one = Simd::Set1(1.0f);
+
+	// Largest |height| of the old and new solution, for activity tracking.  Lanes
+	// of boundary cells are included before they are cleared, which only errs on
+	// the side of keeping a tile awake.
+	Simd::Float magnitude = Simd::Zero();
+
+	// Run whole aligned blocks across the padded row.  The left/right neighbors of
+	// the first and last lanes of a row fall into the padding of the adjacent rows,
+	// which always exists because i is an interior row; those lanes are boundary or
+	// padding cells and are cleared again below.
+	//
+	// With obstacles, a water cell sees its own height in place of each solid
+	// neighbor, so the height has no gradient across the wall and waves reflect off
+	// it, and solid cells are held at zero.  Both are lane selects on the bit mask.
+	for(int j = colBegin; j < colEnd; j += Simd::Width)
+	{
+		Simd::Float c = codec.Load(curr + j);
+		Simd::Float d = codec.Load(down + j);
+		Simd::Float u = codec.Load(up + j);
+		Simd::Float r = codec.LoadU(curr + j + 1);
+		Simd::Float l = codec.LoadU(curr + j - 1);
+		if(Masked)
+		{
+			d = Simd::Select(Simd::MaskFromBits(ObstacleBits(i+1, j)), c, d);
+			u = Simd::Select(Simd::MaskFromBits(ObstacleBits(i-1, j)), c, u);
+			r = Simd::Select(Simd::MaskFromBits(ObstacleBits(i, j+1)), c, r);
+			l = Simd::Select(Simd::MaskFromBits(ObstacleBits(i, j-1)), c, l);
+		}
+
+		Simd::Float sum = Simd::Add(Simd::Add(Simd::Add(d, u), r), l);
+		Simd::Float h = Simd::Add(Simd::Add(
+			Simd::Mul(k1, codec.Load(prev + j)),
+			Simd::Mul(k2, c)),
+			Simd::Mul(k3, sum));
+
+		if(Masked)
+			h = Simd::Select(Simd::MaskFromBits(ObstacleBits(i, j)), Simd::Zero(), h);
+		if(sponge)
+		{
+			Simd::Float w = Simd::Add(rowSponge, Simd::Load(&mSpongeCol[j]));
+			Simd::Float v = Simd::Sub(one, Simd::Mul(w, spongeDamping));
+			Simd::Float s = Simd::Sub(one, Simd::Mul(w, spongeRelax));
+			h = Simd::Mul(Simd::Add(c, Simd::Mul(Simd::Sub(h, c), v)), s);
+		}
+
+		codec.Store(prev + j, h);
+
+		magnitude = Simd::Max(magnitude, Simd::Max(Simd::Abs(h), Simd::Abs(c)));
+	}
+
+	// Restore the zero boundary and keep the padding zero.
+	if(colBegin == 0)
+		prev[0] = 0;
+	for(int j = std::max(colBegin, mNumCols - 1); j < colEnd; ++j)
+		prev[j] = 0;
+
+	return Simd::ReduceMax(magnitude);
 }
-	
@@ -9,39 +9,292 @@
 #ifndef WAVES_H
 #define WAVES_H
 
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 #include <DirectXMath.h>
+#include "../Common/AlignedAllocator.h"
+#include "WaterSurface.h"
 
-class Waves
+class TaskScheduler;
+
+class Waves final : public WaterSurface
 {
 public:
-    Waves(int m, int n, float dx, float dt, float speed, float damping);
+    // A queued disturbance of the grid point in row Row, column Col.
+    struct Impulse
+    {
+        int Row = 0;
+        int Col = 0;
+        float Magnitude = 0.0f;
+
+        // Zero disturbs the point and its four neighbors by half as much, like
+        // Disturb().  Otherwise the disturbance falls off smoothly from Magnitude at
+        // the center to zero at Radius grid steps.
+        float Radius = 0.0f;
+    };
+
+    // Float32 snapshots restore the heights bit for bit.  Quantized16 snapshots
+    // store each height as a 16-bit step of a per-snapshot scale, delta encoded
+    // along rows as zigzag varints; a calm grid compresses to about a byte a cell.
+    enum class SnapshotFormat : std::uint32_t
+    {
+        Float32 = 0,
+        Quantized16 = 1
+    };
+
+    // Explicit is the classic leapfrog scheme; it is cheap per step but only stable
+    // while speed*dt/dx stays below about 0.7.  Implicit averages the Laplacian over
+    // three time levels (Newmark, beta = 1/4) and solves the resulting system with
+    // an ADI split into tridiagonal row and column sweeps.  It is stable for any dt
+    // and costs roughly three explicit steps per step; large steps damp and slow
+    // down short waves.
+    enum class Solver
+    {
+        Explicit,
+        Implicit
+    };
+
+    // Float32 keeps the heights, normals and tangents as floats, 32 bytes a cell.
+    // Half16 and Fixed16 keep only the two height solutions, as half floats or as
+    // 16-bit fixed point (see SetFixedPointRange), 4 bytes a cell, and compute
+    // normals and tangents from the heights when they are asked for.  Steps still
+    // run in float; heights are converted as they are loaded and stored.  The
+    // implicit solver always uses Float32.
+    enum class Storage
+    {
+        Float32,
+        Half16,
+        Fixed16
+    };
+
+    // Outer edge of the grid.  Zero holds the edge cells at height zero; waves bounce
+    // back from it upside down.  Reflective mirrors the heights next to the edge, so
+    // the edge acts as a wall; the water disturbances add then stays in the grid.
+    // Absorbing lets waves run out of the grid: a first order Mur condition on the
+    // edge (exact for waves that hit it head on) behind a sponge layer a few cells
+    // wide that damps what the edge would still reflect.
+    enum class Boundary
+    {
+        Zero,
+        Reflective,
+        Absorbing
+    };
+
+    // Tiles of the grid are updated in parallel on scheduler, or serially on the
+    // calling thread if no scheduler is given.
+    Waves(int m, int n, float dx, float dt, float speed, float damping, TaskScheduler* scheduler = nullptr,
+          Solver solver = Solver::Explicit, Storage storage = Storage::Float32);
     Waves(const Waves& rhs) = delete;
     Waves& operator=(const Waves& rhs) = delete;
     ~Waves();
 
-	int RowCount()const;
-	int ColumnCount()const;
-	int VertexCount()const;
-	int TriangleCount()const;
-	float Width()const;
-	float Depth()const;
+	int RowCount()const override;
+	int ColumnCount()const override;
+	int VertexCount()const override;
+	int TriangleCount()const override;
+	float Width()const override;
+	float Depth()const override;
+	float SpatialStep()const override;
 
-	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+	// Returns the solution at the ith grid point.  Only the height is stored; x and z
+	// are derived from the grid since they never change.  With interpolation enabled
+	// the height is blended between the last two solutions.
+    DirectX::XMFLOAT3 Position(int i)const override
+    {
+        int row = i / mNumCols;
+        int col = i - row*mNumCols;
+        int k = row*mRowPitch + col;
+
+        bool compact = mStorage != Storage::Float32;
+        float y = compact ? DecodeHeight(mCurrCompact[k]) : mCurrSolution[k];
+        if(mInterpolate)
+        {
+            float p = compact ? DecodeHeight(mPrevCompact[k]) : mPrevSolution[k];
+            y = p + (y - p)*mAlpha;
+        }
+
+        return DirectX::XMFLOAT3(
+            -mHalfWidth + col*mSpatialStep,
+            y,
+            mHalfDepth - row*mSpatialStep);
+    }
 
 	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+	DirectX::XMFLOAT3 Normal(int i)const override;
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+	DirectX::XMFLOAT3 TangentX(int i)const override;
+
+	// Writes all VertexCount() vertices to dest, rows in parallel, with texture
+	// coordinates mapping [-w/2,w/2] to [0,1].  dest is typically mapped upload heap
+	// memory, so it is only written (with streaming stores when 16-byte aligned).
+	void WriteVertices(Vertex* dest)const override;
+
+	// Split stream versions of WriteVertices; see StaticVertex.
+	void WriteStaticVertices(StaticVertex* dest)const override;
+	void WriteStreamVertices(StreamVertex* dest)const override;
 
-	void Update(float dt);
+	// Advances the simulation by dt seconds in fixed steps of the time step given at
+	// construction.  At most MaxSubsteps steps run per call; leftover time carries
+	// over to the next call.
+	void Update(float dt) override;
 	void Disturb(int i, int j, float magnitude);
 
+	// Queues impulses to be applied at the start of the next simulation step.  Safe
+	// to call from any thread, including while Update runs.  Impulses are clipped to
+	// the interior of the grid rather than asserted on.
+	void DisturbBatch(const Impulse* impulses, int count);
+
+	// Caps the number of fixed steps a single Update may run (default 4).
+	void SetMaxSubsteps(int count);
+
+	// When enabled, Position() blends between the previous and current solution by
+	// the fraction of a step left in the accumulator.  Normals are not blended.
+	void SetInterpolation(bool enable);
+
+	// Number of fixed steps the last Update ran.
+	int SubstepCount()const;
+
+	// The grid is split into tiles.  A tile goes to sleep, and is skipped by Update,
+	// once every |height| of its last two solutions is below epsilon (default 1e-4).
+	// It wakes up when disturbed or when an awake neighbor tile can reach it.
+	void SetSleepThreshold(float epsilon);
+
+	int TileCount()const;
+
+	// Number of tiles the last simulation step processed.
+	int ActiveTileCount()const;
+
+	// Number of fixed steps run since construction.
+	std::uint64_t StepCount()const;
+
+	// Heights are already reproducible bit for bit across thread counts: tiles are a
+	// fixed partition of the grid, every cell is computed independently with the same
+	// operations in the same order whatever the SIMD width, and no FMA or approximate
+	// reciprocal is used; Waves.cpp turns floating-point contraction off so that the
+	// compiler cannot introduce FMAs either.  Other code that feeds disturbances must
+	// do the same (/fp:precise with fp_contract off, -ffp-contract=off), or replay
+	// hashes only match between builds with the same flags.  Deterministic mode also
+	// removes the dependence on the order in which threads call DisturbBatch, by
+	// sorting every batch before it is applied, and hashes the state after every step
+	// for cheap replay checks.
+	void SetDeterministic(bool enable);
+
+	// Hash of both height solutions after the last step.  Only kept in deterministic
+	// mode; zero otherwise.
+	std::uint64_t StateHash()const;
+
+	// Per-instance random numbers with a fixed, platform independent sequence for
+	// a given seed, for disturbances that have to replay exactly.
+	void SeedRandom(std::uint64_t seed);
+	int RandomInt(int a, int b);          // in [a, b]
+	float RandomFloat(float a, float b);  // in [a, b)
+
+	Storage HeightStorage()const;
+
+	// Fixed16 heights cover [-maxHeight, maxHeight] (default 4) in 65535 steps and
+	// saturate beyond it.  Re-encodes the current solutions at the new range.
+	void SetFixedPointRange(float maxHeight);
+
+	// Bytes held for the grid: heights, normals, tangents, obstacles and solver scratch.
+	std::size_t MemoryFootprint()const;
+
+	// Discrete energy of the last two solutions that an implicit step can only keep
+	// or lower, for any dt; with damping it drops every step.  Only meaningful with
+	// Solver::Implicit.
+	double ImplicitEnergy()const;
+
+	// Boundary and obstacles are only supported by the explicit solver.
+	void SetBoundary(Boundary boundary);
+	Boundary BoundaryMode()const;
+
+	// Marks grid point (i, j) as solid (land, a pier, a wall) or as water again.
+	// Solid points stay at height zero and waves reflect off them.
+	void SetObstacle(int i, int j, bool solid);
+
+	// Marks every grid point whose xz position, in the grid's own space, lies in the
+	// rectangle [minX, maxX] x [minZ, maxZ].
+	void SetObstacleRect(float minX, float minZ, float maxX, float maxZ, bool solid = true);
+
+	bool IsObstacle(int i, int j)const;
+	void ClearObstacles();
+
+	// Appends a snapshot of both height solutions, the step count and the time left
+	// in the accumulator to out.  Queued impulses are not included.
+	void SaveSnapshot(std::vector<std::uint8_t>& out, SnapshotFormat format = SnapshotFormat::Float32)const;
+
+	// Restores a snapshot saved from a grid of the same size.  Returns false and
+	// leaves the simulation untouched if data is not such a snapshot.
+	bool RestoreSnapshot(const std::uint8_t* data, std::size_t size);
+
+private:
+    // A block of rows [RowBegin, RowEnd) and padded-row columns [ColBegin, ColEnd)
+    // that is stepped as one task.  Column bounds are multiples of the SIMD width.
+    struct Tile
+    {
+        int RowBegin = 0;
+        int RowEnd = 0;
+        int ColBegin = 0;
+        int ColEnd = 0;
+
+        // Largest |height| over the tile's last two solutions, and whether that is
+        // above the sleep threshold.  A sleeping tile is exactly flat.
+        float Magnitude = 0.0f;
+        bool Awake = false;
+    };
+
+    void Step();
+    void StepExplicit();
+    void StepImplicit();
+    void ImplicitRow(int i);
+    void ImplicitColumns(int colBegin, int colEnd);
+    void ApplyImpulses();
+    void GetImpulseBounds(const Impulse& impulse, int& rowBegin, int& rowEnd, int& colBegin, int& colEnd)const;
+    void SplatImpulse(const Impulse& impulse, int rowBegin, int rowEnd, int colBegin, int colEnd);
+    void BuildTiles();
+    void GetTileNormalInterior(const Tile& tile, int& rowBegin, int& rowEnd, int& colBegin, int& colEnd)const;
+    bool IsTileActive(int k)const;
+    void WakeCell(int i, int j);
+    void ClearTile(Tile& tile);
+    void UpdateTile(Tile& tile);
+    void ComputeTileEdgeNormals(const Tile& tile);
+    float UpdateRow(int i, int colBegin, int colEnd);
+    template<bool Masked, class Codec>
+    float UpdateRow(const Codec& codec, typename Codec::Type* prevPlane, const typename Codec::Type* currPlane,
+                    int i, int colBegin, int colEnd);
+    void ComputeNormalsRow(const float* heights, int i, int colBegin, int colEnd);
+    void ComputeNormal(const float* heights, int i, int j);
+    void WriteVertexRow(Vertex* dest, int i)const;
+    void WriteStreamVertexRow(StreamVertex* dest, int i)const;
+    template<class Func> void ForEachCompactVertex(int i, const Func& func)const;
+    void ComputeCompactNormal(int i, int j, DirectX::XMFLOAT3* normal, DirectX::XMFLOAT3* tangent)const;
+    float DecodeHeight(std::uint16_t q)const;
+    std::uint16_t EncodeHeight(float h)const;
+    void DecodeHeights(bool current, int k, int count, float* dest)const;
+    void EncodeHeights(bool current, int k, int count, const float* src);
+    float LoadHeight(bool current, int k)const;
+    void StoreHeight(bool current, int k, float h);
+    void AddHeight(int k, float delta);
+    void ApplyBoundary();
+    unsigned ObstacleBits(int i, int j)const;
+    void ComputeStateHash();
+    std::uint32_t NextRandom();
+
 private:
+    // Heights live in 32-byte aligned, row-major float planes.  Each row is padded
+    // to mRowPitch floats so that every row starts on a SIMD boundary.
+    using HeightPlane = std::vector<float, AlignedAllocator<float, 32>>;
+    using CompactPlane = std::vector<std::uint16_t, AlignedAllocator<std::uint16_t, 32>>;
+
+    TaskScheduler* mScheduler = nullptr;
+    Solver mSolver = Solver::Explicit;
+    Storage mStorage = Storage::Float32;
+
     int mNumRows = 0;
     int mNumCols = 0;
+    int mRowPitch = 0;
 
     int mVertexCount = 0;
     int mTriangleCount = 0;
@@ -54,10 +307,87 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
+    // Implicit solver: d*u' - e/2*L(u') = rhs with L the 5-point Laplacian, solved
+    // as (d - e/2*Lx)(d - e/2*Ly)u' = d*rhs.  The Thomas algorithm factors of both
+    // constant tridiagonal matrices are precomputed; see BuildThomasFactors.
+    float mImplicitD = 0.0f;
+    float mImplicitHalfE = 0.0f;
+    std::vector<float> mRowFactorC;
+    std::vector<float> mRowFactorInv;
+    std::vector<float> mColFactorC;
+    std::vector<float> mColFactorInv;
+    HeightPlane mImplicitScratch;
+
+    // Simulation time not yet consumed by a fixed step.
+    float mAccumulator = 0.0f;
+    int mMaxSubsteps = 4;
+    int mSubstepCount = 0;
+
+    bool mInterpolate = false;
+    float mAlpha = 1.0f;
+
+    float mHalfWidth = 0.0f;
+    float mHalfDepth = 0.0f;
+
+    // Float32 storage uses the float planes and the normal and tangent arrays; the
+    // 16-bit modes use only the compact planes, laid out the same way.
+    HeightPlane mPrevSolution;
+    HeightPlane mCurrSolution;
     std::vector<DirectX::XMFLOAT3> mNormals;
     std::vector<DirectX::XMFLOAT3> mTangentX;
+
+    CompactPlane mPrevCompact;
+    CompactPlane mCurrCompact;
+
+    // Height of one Fixed16 step, and its inverse.
+    float mFixedScale = 0.0f;
+    float mFixedInvScale = 0.0f;
+
+    // Outer edge condition, the Mur coefficient (c*dt - dx)/(c*dt + dx), and the
+    // sponge weight of each row and padded-row column, built on first use.
+    Boundary mBoundary = Boundary::Zero;
+    float mAbsorbK = 0.0f;
+    std::vector<float> mSpongeRow;
+    HeightPlane mSpongeCol;
+
+    // One bit per cell, set for solid cells.  Row i starts at byte i*mObstaclePitch
+    // and column j is bit j + 8, so the stencil's neighbor columns -1 and mRowPitch
+    // are still in the row.  The stencil only reads the mask while
+    // mObstacleCount > 0.
+    std::vector<std::uint8_t> mObstacles;
+    int mObstaclePitch = 0;
+    int mObstacleCount = 0;
+
+    // Texture coordinates of each column and row; x and z never change.
+    std::vector<float> mTexU;
+    std::vector<float> mTexV;
+
+    std::vector<Tile> mTiles;
+    std::vector<int> mActiveTiles;
+
+    int mTileRows = 0;
+    int mTileCols = 0;
+    int mTileGridRows = 0;
+    int mTileGridCols = 0;
+
+    float mSleepThreshold = 1e-4f;
+
+    // Impulses submitted by DisturbBatch, guarded by mImpulseMutex, and the batch the
+    // current step is applying.  Each impulse is binned by index into every tile
+    // its footprint overlaps, so tiles can be splatted in parallel.
+    std::mutex mImpulseMutex;
+    std::vector<Impulse> mPendingImpulses;
+    std::vector<Impulse> mImpulses;
+    std::vector<std::vector<int>> mTileImpulses;
+    std::vector<int> mSplatTiles;
+
+    std::uint64_t mStepCount = 0;
+
+    bool mDeterministic = false;
+    std::uint64_t mStateHash = 0;
+    std::vector<std::uint64_t> mRowHashes;
+
+    std::uint64_t mRandomState = 0;
 };
 
 #endif // WAVES_H
\ No newline at end of file
@@ -0,0 +1,330 @@
+//***************************************************************************************
+// WavesLod.cpp
+//***************************************************************************************
+
+#include "WavesLod.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <unordered_set>
+
+using namespace DirectX;
+
+namespace
+{
+    // Grid lines begin, begin + stride, ... up to and always including end.
+    std::vector<int> Samples(int begin, int end, int stride)
+    {
+        std::vector<int> samples;
+        for(int k = begin; k < end; k += stride)
+            samples.push_back(k);
+        samples.push_back(end);
+        return samples;
+    }
+
+    // Tile boundaries along an axis of quads quads.
+    std::vector<int> TileBounds(int quads, int tileQuads)
+    {
+        int count = std::max(1, quads / tileQuads);
+
+        std::vector<int> bounds;
+        for(int k = 0; k < count; ++k)
+            bounds.push_back(k*tileQuads);
+        bounds.push_back(quads);
+        return bounds;
+    }
+}
+
+WavesLod::WavesLod(int m, int n, float dx, int tileQuads)
+{
+    assert(m >= 3 && n >= 3);
+
+    // A tile side needs an interior grid point for BuildSide to stitch to.
+    assert(tileQuads >= 2);
+
+    mNumRows = m;
+    mNumCols = n;
+
+    std::vector<int> rowBounds = TileBounds(m - 1, tileQuads);
+    std::vector<int> colBounds = TileBounds(n - 1, tileQuads);
+
+    mTileGridRows = (int)rowBounds.size() - 1;
+    mTileGridCols = (int)colBounds.size() - 1;
+
+    float halfWidth = (n - 1)*dx*0.5f;
+    float halfDepth = (m - 1)*dx*0.5f;
+
+    mTiles.resize(mTileGridRows*mTileGridCols);
+    for(int tr = 0; tr < mTileGridRows; ++tr)
+    {
+        for(int tc = 0; tc < mTileGridCols; ++tc)
+        {
+            Tile& tile = mTiles[tr*mTileGridCols + tc];
+            tile.RowBegin = rowBounds[tr];
+            tile.RowEnd = rowBounds[tr + 1];
+            tile.ColBegin = colBounds[tc];
+            tile.ColEnd = colBounds[tc + 1];
+
+            tile.CenterX = -halfWidth + 0.5f*(tile.ColBegin + tile.ColEnd)*dx;
+            tile.CenterZ = halfDepth - 0.5f*(tile.RowBegin + tile.RowEnd)*dx;
+
+            BuildTile(tile);
+        }
+    }
+}
+
+WavesLod::~WavesLod()
+{
+}
+
+int WavesLod::TileCount()const
+{
+    return (int)mTiles.size();
+}
+
+int WavesLod::MaxIndexCount()const
+{
+    return 6*(mNumRows - 1)*(mNumCols - 1);
+}
+
+void WavesLod::SelectLods(const XMFLOAT3& eyeL, float lodDistance)
+{
+    for(Tile& tile : mTiles)
+    {
+        float dx = tile.CenterX - eyeL.x;
+        float dz = tile.CenterZ - eyeL.z;
+        float d = std::sqrt(dx*dx + eyeL.y*eyeL.y + dz*dz);
+
+        int lod = 0;
+        for(float limit = lodDistance; d >= limit && lod < LodCount - 1; limit *= 2.0f)
+            ++lod;
+
+        tile.Lod = std::min(lod, tile.MaxLod);
+    }
+}
+
+int WavesLod::TileLod(int tile)const
+{
+    return mTiles[tile].Lod;
+}
+
+void WavesLod::SetTileLod(int tile, int lod)
+{
+    mTiles[tile].Lod = std::min(std::max(lod, 0), mTiles[tile].MaxLod);
+}
+
+int WavesLod::WriteIndices(std::uint32_t* dest)const
+{
+    int count = 0;
+    auto append = [this, dest, &count](const IndexRange& range)
+    {
+        if(range.Count == 0)
+            return;
+
+        std::memcpy(dest + count, &mIndices[range.Start], range.Count*sizeof(std::uint32_t));
+        count += range.Count;
+    };
+
+    for(int k = 0; k < TileCount(); ++k)
+    {
+        const Tile& tile = mTiles[k];
+
+        append(tile.Interior[tile.Lod]);
+        for(int side = 0; side < SideCount; ++side)
+            append(tile.Sides[side][tile.Lod][EdgeLod(k, (Side)side)]);
+    }
+
+    return count;
+}
+
+bool WavesLod::ValidateStitching()const
+{
+    std::vector<std::uint32_t> indices(MaxIndexCount());
+    int count = WriteIndices(indices.data());
+
+    // Directed edges; in a consistently wound mesh each appears at most once.
+    std::unordered_set<std::uint64_t> edges;
+    long long doubleArea = 0;
+    for(int t = 0; t < count; t += 3)
+    {
+        int r[3], c[3];
+        for(int k = 0; k < 3; ++k)
+        {
+            r[k] = indices[t + k] / mNumCols;
+            c[k] = indices[t + k] % mNumCols;
+        }
+
+        long long cross = (long long)(c[1] - c[0])*(r[2] - r[0]) - (long long)(r[1] - r[0])*(c[2] - c[0]);
+        if(cross <= 0)
+            return false;
+        doubleArea += cross;
+
+        for(int k = 0; k < 3; ++k)
+        {
+            std::uint64_t from = indices[t + k];
+            std::uint64_t to = indices[t + (k + 1) % 3];
+            if(!edges.insert(from << 32 | to).second)
+                return false;
+        }
+    }
+
+    // No overlaps or holes.
+    if(doubleArea != 2LL*(mNumRows - 1)*(mNumCols - 1))
+        return false;
+
+    // An edge without a twin running the other way is a crack unless it lies on the
+    // border of the grid.
+    for(std::uint64_t edge : edges)
+    {
+        std::uint64_t from = edge >> 32;
+        std::uint64_t to = edge & 0xffffffff;
+        if(edges.count(to << 32 | from) != 0)
+            continue;
+
+        int r0 = (int)from / mNumCols, c0 = (int)from % mNumCols;
+        int r1 = (int)to / mNumCols, c1 = (int)to % mNumCols;
+
+        bool border =
+            (r0 == r1 && (r0 == 0 || r0 == mNumRows - 1)) ||
+            (c0 == c1 && (c0 == 0 || c0 == mNumCols - 1));
+        if(!border)
+            return false;
+    }
+
+    return true;
+}
+
+void WavesLod::BuildTile(Tile& tile)
+{
+    // A tile needs at least one inner grid line at its stride in each direction.
+    int quads = std::min(tile.RowEnd - tile.RowBegin, tile.ColEnd - tile.ColBegin);
+    tile.MaxLod = 0;
+    while(tile.MaxLod + 1 < LodCount && (1 << (tile.MaxLod + 1)) < quads)
+        ++tile.MaxLod;
+
+    for(int lod = 0; lod <= tile.MaxLod; ++lod)
+    {
+        std::vector<int> rows = Samples(tile.RowBegin, tile.RowEnd, 1 << lod);
+        std::vector<int> cols = Samples(tile.ColBegin, tile.ColEnd, 1 << lod);
+
+        // Quads between the inner grid lines, split like the full-resolution grid.
+        tile.Interior[lod].Start = (int)mIndices.size();
+        for(size_t a = 1; a + 2 < rows.size(); ++a)
+        {
+            for(size_t b = 1; b + 2 < cols.size(); ++b)
+            {
+                AddTriangle(rows[a], cols[b], rows[a], cols[b+1], rows[a+1], cols[b]);
+                AddTriangle(rows[a+1], cols[b], rows[a], cols[b+1], rows[a+1], cols[b+1]);
+            }
+        }
+        tile.Interior[lod].Count = (int)mIndices.size() - tile.Interior[lod].Start;
+
+        for(int side = 0; side < SideCount; ++side)
+        {
+            for(int edgeLod = lod; edgeLod < LodCount; ++edgeLod)
+                BuildSide(tile, (Side)side, lod, edgeLod);
+        }
+    }
+}
+
+void WavesLod::BuildSide(Tile& tile, Side side, int lod, int edgeLod)
+{
+    std::vector<int> rows = Samples(tile.RowBegin, tile.RowEnd, 1 << lod);
+    std::vector<int> cols = Samples(tile.ColBegin, tile.ColEnd, 1 << lod);
+
+    // The inner line runs between two corners of the rectangle spanned by the inner
+    // grid lines; the outer edge between the matching tile corners.
+    bool horizontal = side == Top || side == Bottom;
+    const std::vector<int>& along = horizontal ? cols : rows;
+
+    std::vector<int> inner(along.begin() + 1, along.end() - 1);
+    std::vector<int> outer = horizontal ?
+        Samples(tile.ColBegin, tile.ColEnd, 1 << edgeLod) :
+        Samples(tile.RowBegin, tile.RowEnd, 1 << edgeLod);
+
+    int innerLine = 0;
+    int outerLine = 0;
+    switch(side)
+    {
+    case Top:    innerLine = rows[1];               outerLine = tile.RowBegin; break;
+    case Bottom: innerLine = rows[rows.size() - 2]; outerLine = tile.RowEnd;   break;
+    case Left:   innerLine = cols[1];               outerLine = tile.ColBegin; break;
+    default:     innerLine = cols[cols.size() - 2]; outerLine = tile.ColEnd;   break;
+    }
+
+    // Zip the two lines together, always advancing along the one whose next point
+    // comes first.
+    auto triangle = [this, horizontal](int line0, int t0, int line1, int t1, int line2, int t2)
+    {
+        if(horizontal)
+            AddTriangle(line0, t0, line1, t1, line2, t2);
+        else
+            AddTriangle(t0, line0, t1, line1, t2, line2);
+    };
+
+    IndexRange& range = tile.Sides[side][lod][edgeLod];
+    range.Start = (int)mIndices.size();
+
+    size_t i = 0;
+    size_t j = 0;
+    while(i + 1 < inner.size() || j + 1 < outer.size())
+    {
+        bool advanceInner = j + 1 == outer.size() ||
+            (i + 1 < inner.size() && inner[i+1] <= outer[j+1]);
+
+        if(advanceInner)
+        {
+            triangle(innerLine, inner[i], outerLine, outer[j], innerLine, inner[i+1]);
+            ++i;
+        }
+        else
+        {
+            triangle(innerLine, inner[i], outerLine, outer[j], outerLine, outer[j+1]);
+            ++j;
+        }
+    }
+
+    range.Count = (int)mIndices.size() - range.Start;
+}
+
+void WavesLod::AddTriangle(int r0, int c0, int r1, int c1, int r2, int c2)
+{
+    // Wind every triangle like the full-resolution grid, where (i,j), (i,j+1),
+    // (i+1,j) has a positive cross product in (column, row) coordinates.
+    int cross = (c1 - c0)*(r2 - r0) - (r1 - r0)*(c2 - c0);
+    if(cross == 0)
+        return;
+
+    if(cross < 0)
+    {
+        std::swap(r1, r2);
+        std::swap(c1, c2);
+    }
+
+    mIndices.push_back(r0*mNumCols + c0);
+    mIndices.push_back(r1*mNumCols + c1);
+    mIndices.push_back(r2*mNumCols + c2);
+}
+
+int WavesLod::Neighbor(int tile, Side side)const
+{
+    int tr = tile / mTileGridCols;
+    int tc = tile % mTileGridCols;
+
+    switch(side)
+    {
+    case Top:    return tr > 0 ? tile - mTileGridCols : -1;
+    case Bottom: return tr + 1 < mTileGridRows ? tile + mTileGridCols : -1;
+    case Left:   return tc > 0 ? tile - 1 : -1;
+    default:     return tc + 1 < mTileGridCols ? tile + 1 : -1;
+    }
+}
+
+int WavesLod::EdgeLod(int tile, Side side)const
+{
+    // Both tiles sharing an edge sample it at the coarser of their strides.
+    int neighbor = Neighbor(tile, side);
+    int lod = mTiles[tile].Lod;
+    return neighbor < 0 ? lod : std::max(lod, mTiles[neighbor].Lod);
+}
@@ -0,0 +1,107 @@
+//***************************************************************************************
+// WavesLod.h
+//
+// Level-of-detail triangulation of a wave grid.  The grid is split into square tiles
+// that are drawn with every 1st, 2nd, 4th or 8th grid point depending on their
+// distance from the camera.  The outermost ring of quads of a tile is stitched to
+// its neighbors: each tile edge is sampled at the coarser stride of the two tiles
+// that share it, so both sides use the same vertices and there are no cracks.
+//
+// Index lists for every tile, LOD and edge stride are built once; selecting LODs
+// and writing the index buffer each frame only copies precomputed ranges.
+//***************************************************************************************
+
+#ifndef WAVESLOD_H
+#define WAVESLOD_H
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+class WavesLod
+{
+public:
+    // Strides 1, 2, 4 and 8.
+    static const int LodCount = 4;
+
+    // m x n grid points dx apart, laid out like Waves: row i at z = d/2 - i*dx and
+    // column j at x = -w/2 + j*dx.  Tiles are tileQuads quads across; the last tile
+    // of each row and column also takes the quads left over.  tileQuads must be at
+    // least 2.
+    WavesLod(int m, int n, float dx, int tileQuads = 32);
+    WavesLod(const WavesLod& rhs) = delete;
+    WavesLod& operator=(const WavesLod& rhs) = delete;
+    ~WavesLod();
+
+    int TileCount()const;
+
+    // Upper bound on the index count written by WriteIndices (all tiles at LOD 0).
+    int MaxIndexCount()const;
+
+    // Picks each tile's LOD from its distance to eyeL, given in the grid's local
+    // space.  Tiles closer than lodDistance use LOD 0, and every doubling of the
+    // distance beyond that drops one level.
+    void SelectLods(const DirectX::XMFLOAT3& eyeL, float lodDistance);
+
+    int TileLod(int tile)const;
+    void SetTileLod(int tile, int lod);
+
+    // Writes the triangle list for the current LODs to dest and returns the number
+    // of indices written.
+    int WriteIndices(std::uint32_t* dest)const;
+
+    // Checks that the triangle list for the current LODs covers the grid exactly:
+    // every triangle is wound like the full-resolution grid, and every edge is
+    // shared by exactly two triangles unless it lies on the grid border.
+    bool ValidateStitching()const;
+
+private:
+    enum Side { Top = 0, Bottom, Left, Right, SideCount };
+
+    struct IndexRange
+    {
+        int Start = 0;
+        int Count = 0;
+    };
+
+    // Grid point rows [RowBegin, RowEnd] and columns [ColBegin, ColEnd], corners
+    // included, and precomputed index ranges.  Sides[s][lod][edgeLod] is the ring
+    // strip along side s with its inner line at the tile's stride and its outer
+    // edge at the edge's stride; only edgeLod >= lod is filled in.
+    struct Tile
+    {
+        int RowBegin = 0;
+        int RowEnd = 0;
+        int ColBegin = 0;
+        int ColEnd = 0;
+
+        int MaxLod = 0;
+        int Lod = 0;
+
+        float CenterX = 0.0f;
+        float CenterZ = 0.0f;
+
+        IndexRange Interior[LodCount];
+        IndexRange Sides[SideCount][LodCount][LodCount];
+    };
+
+    void BuildTile(Tile& tile);
+    void BuildSide(Tile& tile, Side side, int lod, int edgeLod);
+    void AddTriangle(int r0, int c0, int r1, int c1, int r2, int c2);
+    int Neighbor(int tile, Side side)const;
+    int EdgeLod(int tile, Side side)const;
+
+private:
+    int mNumRows = 0;
+    int mNumCols = 0;
+
+    int mTileGridRows = 0;
+    int mTileGridCols = 0;
+
+    std::vector<Tile> mTiles;
+
+    // All precomputed index lists back to back.
+    std::vector<std::uint32_t> mIndices;
+};
+
+#endif // WAVESLOD_H
@@ -0,0 +1,204 @@
+//***************************************************************************************
+// WavesSnapshotWriter.cpp
+//***************************************************************************************
+
+#include "WavesSnapshotWriter.h"
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const std::uint32_t FileMagic = 0x50534157; // "WASP"
+    const std::uint32_t FileVersion = 1;
+
+    // Room for a few quantized snapshots of a mid-sized grid before the first remap.
+    const std::size_t InitialCapacity = 1 << 20;
+}
+
+WavesSnapshotWriter::WavesSnapshotWriter()
+{
+}
+
+WavesSnapshotWriter::~WavesSnapshotWriter()
+{
+    Close();
+}
+
+bool WavesSnapshotWriter::Open(const std::string& path, int interval, Waves::SnapshotFormat format)
+{
+    Close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+    mFile = file;
+#else
+    mFile = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(mFile < 0)
+        return false;
+#endif
+
+    if(!Map(InitialCapacity))
+    {
+        Close();
+        return false;
+    }
+
+    mInterval = interval > 0 ? interval : 1;
+    mFormat = format;
+    mNextStep = 0;
+    mSnapshotCount = 0;
+
+    FileHeader header = {};
+    header.Magic = FileMagic;
+    header.Version = FileVersion;
+    header.SnapshotCount = 0;
+    header.Interval = (std::uint32_t)mInterval;
+    std::memcpy(mView, &header, sizeof(header));
+    mSize = sizeof(header);
+
+    return true;
+}
+
+void WavesSnapshotWriter::Close()
+{
+    if(!IsOpen())
+        return;
+
+    Unmap();
+
+    // The mapping grew the file in large steps; cut it back to what was written.
+#if defined(_WIN32)
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG)mSize;
+    SetFilePointerEx((HANDLE)mFile, size, nullptr, FILE_BEGIN);
+    SetEndOfFile((HANDLE)mFile);
+    CloseHandle((HANDLE)mFile);
+    mFile = nullptr;
+#else
+    // Failing to trim only leaves zeros after the last record.
+    int trimmed = ftruncate(mFile, (off_t)mSize);
+    (void)trimmed;
+    close(mFile);
+    mFile = -1;
+#endif
+
+    mSize = 0;
+}
+
+bool WavesSnapshotWriter::IsOpen()const
+{
+#if defined(_WIN32)
+    return mFile != nullptr;
+#else
+    return mFile >= 0;
+#endif
+}
+
+bool WavesSnapshotWriter::Capture(const Waves& waves)
+{
+    if(!IsOpen() || waves.StepCount() < mNextStep)
+        return true;
+
+    mNextStep = waves.StepCount() + mInterval;
+
+    mScratch.clear();
+    waves.SaveSnapshot(mScratch, mFormat);
+
+    if(!Append(mScratch))
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+int WavesSnapshotWriter::SnapshotCount()const
+{
+    return mSnapshotCount;
+}
+
+bool WavesSnapshotWriter::Append(const std::vector<std::uint8_t>& snapshot)
+{
+    std::uint32_t byteCount = (std::uint32_t)snapshot.size();
+    std::size_t required = mSize + sizeof(byteCount) + snapshot.size();
+
+    if(required > mCapacity)
+    {
+        std::size_t capacity = 2*mCapacity;
+        if(capacity < required)
+            capacity = required;
+
+        Unmap();
+        if(!Map(capacity))
+            return false;
+    }
+
+    std::memcpy(mView + mSize, &byteCount, sizeof(byteCount));
+    std::memcpy(mView + mSize + sizeof(byteCount), snapshot.data(), snapshot.size());
+    mSize = required;
+
+    ++mSnapshotCount;
+    FileHeader* header = reinterpret_cast<FileHeader*>(mView);
+    header->SnapshotCount = (std::uint32_t)mSnapshotCount;
+
+    return true;
+}
+
+bool WavesSnapshotWriter::Map(std::size_t capacity)
+{
+#if defined(_WIN32)
+    std::uint64_t size = capacity;
+    HANDLE mapping = CreateFileMappingA((HANDLE)mFile, nullptr, PAGE_READWRITE,
+        (DWORD)(size >> 32), (DWORD)(size & 0xffffffff), nullptr);
+    if(mapping == nullptr)
+        return false;
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, capacity);
+    if(view == nullptr)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    mMapping = mapping;
+#else
+    if(ftruncate(mFile, (off_t)capacity) != 0)
+        return false;
+
+    void* view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0);
+    if(view == MAP_FAILED)
+        return false;
+#endif
+
+    mView = static_cast<std::uint8_t*>(view);
+    mCapacity = capacity;
+    return true;
+}
+
+void WavesSnapshotWriter::Unmap()
+{
+    if(mView == nullptr)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(mView);
+    CloseHandle((HANDLE)mMapping);
+    mMapping = nullptr;
+#else
+    munmap(mView, mCapacity);
+#endif
+
+    mView = nullptr;
+    mCapacity = 0;
+}
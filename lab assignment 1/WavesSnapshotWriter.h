@@ -0,0 +1,77 @@
+//***************************************************************************************
+// WavesSnapshotWriter.h
+//
+// Appends a Waves snapshot every N simulation steps to a memory-mapped file, for warm
+// starts and for scrubbing through a recorded simulation.
+//
+// File layout: a FileHeader followed by records, each a 32-bit byte count and a
+// snapshot as written by Waves::SaveSnapshot.  The file grows by remapping it at
+// twice the size when full, and is trimmed to the records written on Close.
+//***************************************************************************************
+
+#ifndef WAVESSNAPSHOTWRITER_H
+#define WAVESSNAPSHOTWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Waves.h"
+
+class WavesSnapshotWriter
+{
+public:
+    struct FileHeader
+    {
+        std::uint32_t Magic;
+        std::uint32_t Version;
+
+        // Number of records that follow; kept current as records are appended.
+        std::uint32_t SnapshotCount;
+        std::uint32_t Interval;
+    };
+
+    WavesSnapshotWriter();
+    WavesSnapshotWriter(const WavesSnapshotWriter& rhs) = delete;
+    WavesSnapshotWriter& operator=(const WavesSnapshotWriter& rhs) = delete;
+    ~WavesSnapshotWriter();
+
+    // Creates (or overwrites) the file at path.  Returns false if it cannot be
+    // created or mapped.
+    bool Open(const std::string& path, int interval, Waves::SnapshotFormat format = Waves::SnapshotFormat::Quantized16);
+    void Close();
+    bool IsOpen()const;
+
+    // Call after every Waves::Update.  Appends a snapshot once waves has run at
+    // least interval steps since the last one.  Returns false if the file could
+    // not be grown; the writer is closed in that case.
+    bool Capture(const Waves& waves);
+
+    int SnapshotCount()const;
+
+private:
+    bool Append(const std::vector<std::uint8_t>& snapshot);
+    bool Map(std::size_t capacity);
+    void Unmap();
+
+private:
+#if defined(_WIN32)
+    void* mFile = nullptr;      // HANDLE
+    void* mMapping = nullptr;   // HANDLE
+#else
+    int mFile = -1;
+#endif
+    std::uint8_t* mView = nullptr;
+    std::size_t mCapacity = 0;
+    std::size_t mSize = 0;
+
+    int mInterval = 1;
+    Waves::SnapshotFormat mFormat = Waves::SnapshotFormat::Quantized16;
+    std::uint64_t mNextStep = 0;
+    int mSnapshotCount = 0;
+
+    // Reused serialization buffer.
+    std::vector<std::uint8_t> mScratch;
+};
+
+#endif // WAVESSNAPSHOTWRITER_H
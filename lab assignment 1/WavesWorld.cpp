@@ -0,0 +1,50 @@
+//***************************************************************************************
+// WavesWorld.cpp
+//***************************************************************************************
+
+#include "WavesWorld.h"
+#include "../Common/TaskScheduler.h"
+#include <algorithm>
+
+WavesWorld::WavesWorld(TaskScheduler* scheduler)
+{
+    mScheduler = scheduler;
+}
+
+WavesWorld::~WavesWorld()
+{
+}
+
+Waves* WavesWorld::Add(int m, int n, float dx, float dt, float speed, float damping, Waves::Solver solver,
+                       Waves::Storage storage)
+{
+    mWaves.push_back(std::make_unique<Waves>(m, n, dx, dt, speed, damping, mScheduler, solver, storage));
+    return mWaves.back().get();
+}
+
+void WavesWorld::Remove(Waves* waves)
+{
+    auto it = std::find_if(mWaves.begin(), mWaves.end(),
+        [waves](const std::unique_ptr<Waves>& w) { return w.get() == waves; });
+
+    if(it != mWaves.end())
+        mWaves.erase(it);
+}
+
+int WavesWorld::Count()const
+{
+    return (int)mWaves.size();
+}
+
+Waves* WavesWorld::Get(int i)const
+{
+    return mWaves[i].get();
+}
+
+void WavesWorld::Update(float dt)
+{
+    ParallelFor(mScheduler, 0, (int)mWaves.size(), 1, [this, dt](int i)
+    {
+        mWaves[i]->Update(dt);
+    });
+}
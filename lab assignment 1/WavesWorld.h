@@ -0,0 +1,46 @@
+//***************************************************************************************
+// WavesWorld.h
+//
+// Owns several independent wave grids (ponds, rivers, ...) and steps them together.
+// Each grid keeps its own timing state, so grids never interfere with each other.
+//***************************************************************************************
+
+#ifndef WAVESWORLD_H
+#define WAVESWORLD_H
+
+#include <memory>
+#include <vector>
+#include "Waves.h"
+
+class TaskScheduler;
+
+class WavesWorld
+{
+public:
+    // Grids are stepped concurrently on scheduler, or one after another on the
+    // calling thread if no scheduler is given.
+    explicit WavesWorld(TaskScheduler* scheduler = nullptr);
+    WavesWorld(const WavesWorld& rhs) = delete;
+    WavesWorld& operator=(const WavesWorld& rhs) = delete;
+    ~WavesWorld();
+
+    // Creates a grid owned by the world.  See the Waves constructor for the parameters.
+    Waves* Add(int m, int n, float dx, float dt, float speed, float damping,
+               Waves::Solver solver = Waves::Solver::Explicit,
+               Waves::Storage storage = Waves::Storage::Float32);
+    void Remove(Waves* waves);
+
+    int Count()const;
+    Waves* Get(int i)const;
+
+    // Advances every grid by dt.  All grids are submitted as a single parallel job;
+    // each grid's own tile passes run on the same scheduler, nested inside it.
+    void Update(float dt);
+
+private:
+    TaskScheduler* mScheduler = nullptr;
+
+    std::vector<std::unique_ptr<Waves>> mWaves;
+};
+
+#endif // WAVESWORLD_H
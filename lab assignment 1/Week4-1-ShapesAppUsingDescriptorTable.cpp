@@ -6,8 +6,14 @@
 #include "../Common/MathHelper.h"
 #include "../Common/UploadBuffer.h"
 #include "../Common/GeometryGenerator.h"
+#include "../Common/MeshOptimizer.h"
+#include "../Common/TaskScheduler.h"
 #include "FrameResource.h"
-#include "Waves.h"
+#include "MeshBatchBuilder.h"
+#include "Ocean.h"
+#include "WaterSimThread.h"
+#include "WavesLod.h"
+#include "WavesWorld.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -25,6 +31,15 @@ struct RenderItem
     RenderItem() = default;
     RenderItem(const RenderItem& rhs) = delete;
 
+    // Draws submesh of Geo: copies its DrawIndexedInstanced parameters and bounds.
+    void SetSubmesh(const SubmeshGeometry& submesh)
+    {
+        IndexCount = submesh.IndexCount;
+        StartIndexLocation = submesh.StartIndexLocation;
+        BaseVertexLocation = submesh.BaseVertexLocation;
+        Bounds = submesh.Bounds;
+    }
+
     // World matrix of the shape that describes the object's local space
     // relative to the world space, which defines the position, orientation,
     // and scale of the object in the world.
@@ -51,12 +66,24 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+    // Bounds of the submesh, which packed vertex positions are relative to.
+    DirectX::BoundingBox Bounds;
+
+    // Optional second vertex stream bound to input slot 1 next to Geo's vertex
+    // buffer, e.g. the per-frame wave heights.  Unused while BufferLocation is 0.
+    D3D12_VERTEX_BUFFER_VIEW StreamVertexBufferView = {};
+
+    // Optional per-frame index buffer used instead of Geo's, e.g. the wave grid
+    // triangulated for the current LODs.  Unused while BufferLocation is 0.
+    D3D12_INDEX_BUFFER_VIEW DynamicIndexBufferView = {};
 };
 
 enum class RenderLayer : int
 {
     Opaque = 0,
     Transparent,
+    TransparentWaves,
     AlphaTested,
     AlphaTestedTreeSprites,
     Count
@@ -124,6 +151,7 @@ private:
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
     std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> mWavesInputLayout;
 
     RenderItem* mWavesRitem = nullptr;
 
@@ -132,7 +160,36 @@ private:
 
     std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
-    std::unique_ptr<Waves> mWaves;
+    // Worker threads for CPU-side passes such as the wave simulation.  Declared
+    // before its users so that it is destroyed after them.
+    std::unique_ptr<TaskScheduler> mScheduler;
+
+    // All water grids of the scene; mWaves is the pond around the castle.
+    std::unique_ptr<WavesWorld> mWavesWorld;
+    Waves* mWaves = nullptr;
+
+    // Open sea alternative to the pond simulation.  mWater is the surface that is
+    // drawn: mOcean when mUseOcean is set, mWaves otherwise.
+    bool mUseOcean = false;
+    std::unique_ptr<Ocean> mOcean;
+    WaterSurface* mWater = nullptr;
+
+    // Store the shapes in PackedVertexLayout (16 bytes a vertex) rather than
+    // VertexLayout (32 bytes).
+    bool mPackShapeVertices = true;
+
+    // Steps all water surfaces on a worker thread, one frame ahead of rendering.
+    // Declared after the surfaces so that the worker is stopped before they go.
+    std::unique_ptr<WaterSimThread> mWaterSim;
+
+    // Simulation time at which the pond is next disturbed.
+    float mNextWavesDisturbTime = 0.25f;
+
+    // Per-tile level of detail of the pond's triangle list.  Tiles closer to the
+    // eye than mWavesLodDistance (in the grid's local space) are drawn at full
+    // resolution.
+    std::unique_ptr<WavesLod> mWavesLod;
+    float mWavesLodDistance = 24.0f;
 
     // Render items divided by PSO.
     std::vector<RenderItem*> mOpaqueRitems;
@@ -196,7 +253,50 @@ bool ShapesApp::Initialize()
     // so we have to query this information.
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-    mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+    mScheduler = std::make_unique<TaskScheduler>();
+
+    mWavesWorld = std::make_unique<WavesWorld>(mScheduler.get());
+    mWaves = mWavesWorld->Add(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+
+    // Waves run out of the open edges of the grid and bounce off the structures
+    // standing in the water.  The water is drawn scaled by 3 in x and z (see
+    // BuildRenderItems), so world footprints are scaled down to grid space; each
+    // covers at least one grid point.
+    mWaves->SetBoundary(Waves::Boundary::Absorbing);
+    auto addObstacle = [this](float x, float z, float halfX, float halfZ)
+    {
+        const float waterScale = 3.0f;
+        float minHalf = 0.5f * mWaves->SpatialStep();
+        float hx = std::max(halfX / waterScale, minHalf);
+        float hz = std::max(halfZ / waterScale, minHalf);
+        x /= waterScale;
+        z /= waterScale;
+        mWaves->SetObstacleRect(x - hx, z - hz, x + hx, z + hz);
+    };
+    addObstacle(0.0f, 0.0f, 7.0f, 7.0f);      // front box
+    addObstacle(0.0f, 25.0f, 20.0f, 20.0f);   // lowest tier of the tower
+    for (int i = 0; i < 6; i++)
+    {
+        for (int u = -1; u <= 1; u = u + 2)
+            addObstacle(25.0f * u, 10.0f * i, 1.0f, 1.0f);   // tree trunks
+    }
+
+    if (mUseOcean)
+    {
+        mOcean = std::make_unique<Ocean>(128, 128.0f, 10.0f, XMFLOAT2(1.0f, 0.3f), 1e-6f, mScheduler.get());
+        mWater = mOcean.get();
+    }
+    else
+    {
+        mWater = mWaves;
+    }
+
+    mWaterSim = std::make_unique<WaterSimThread>(mWater, [this](float dt)
+    {
+        mWavesWorld->Update(dt);
+        if (mOcean)
+            mOcean->Update(dt);
+    });
 
     LoadTextures();
     BuildRootSignature();
@@ -306,6 +406,9 @@ void ShapesApp::Draw(const GameTimer& gt)
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
         D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
+    mCommandList->SetPipelineState(mPSOs["transparentWaves"].Get());
+    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::TransparentWaves]);
+
     mCommandList->SetPipelineState(mPSOs["transparent"].Get());
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
 
@@ -437,6 +540,8 @@ void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
             ObjectConstants objConstants;
             XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
             XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+            objConstants.BoundsCenter = e->Bounds.Center;
+            objConstants.BoundsExtents = e->Bounds.Extents;
 
             currObjectCB->CopyData(e->ObjCBIndex, objConstants);
 
@@ -537,41 +642,54 @@ void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
 void ShapesApp::UpdateWaves(const GameTimer& gt)
 {
     // Every quarter second, generate a random wave.
-    static float t_base = 0.0f;
-    if ((mTimer.TotalTime() - t_base) >= 0.25f)
+    if (mTimer.TotalTime() >= mNextWavesDisturbTime)
     {
-        t_base += 0.25f;
-
-        int i = MathHelper::Rand(4, mWaves->RowCount() - 5);
-        int j = MathHelper::Rand(4, mWaves->ColumnCount() - 5);
+        mNextWavesDisturbTime += 0.25f;
 
-        float r = MathHelper::RandF(0.2f, 0.5f);
+        Waves::Impulse impulse;
+        impulse.Row = mWaves->RandomInt(4, mWaves->RowCount() - 5);
+        impulse.Col = mWaves->RandomInt(4, mWaves->ColumnCount() - 5);
+        impulse.Magnitude = mWaves->RandomFloat(0.2f, 0.5f);
 
-        mWaves->Disturb(i, j, r);
+        mWaves->DisturbBatch(&impulse, 1);
     }
 
-    // Update the wave simulation.
-    mWaves->Update(gt.DeltaTime());
+    // Take the newest solution the simulation thread has finished and start it on
+    // the next one, which runs while this frame is recorded and drawn.
+    const WaterSimThread::Frame& waterFrame = mWaterSim->Latest();
+    mWaterSim->Submit(gt.DeltaTime());
 
-    // Update the wave vertex buffer with the new solution.
+    // Copy the wave heights and normals into the mapped upload memory.  The rest of
+    // the vertex is static.
     auto currWavesVB = mCurrFrameResource->WavesVB.get();
-    for (int i = 0; i < mWaves->VertexCount(); ++i)
-    {
-        Vertex v;
-
-        v.Pos = mWaves->Position(i);
-        v.Normal = mWaves->Normal(i);
-
-        // Derive tex-coords from position by 
-        // mapping [-w/2,w/2] --> [0,1]
-        v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-        v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
-
-        currWavesVB->CopyData(i, v);
-    }
-
-    // Set the dynamic VB of the wave renderitem to the current frame VB.
-    mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+    CopyMemory(currWavesVB->MappedData(), waterFrame.Vertices.data(),
+        waterFrame.Vertices.size() * sizeof(WaterSurface::StreamVertex));
+
+    // Bind the current frame VB as the dynamic stream of the wave renderitem.
+    D3D12_VERTEX_BUFFER_VIEW& streamView = mWavesRitem->StreamVertexBufferView;
+    streamView.BufferLocation = currWavesVB->Resource()->GetGPUVirtualAddress();
+    streamView.StrideInBytes = sizeof(WaterSurface::StreamVertex);
+    streamView.SizeInBytes = mWater->VertexCount() * sizeof(WaterSurface::StreamVertex);
+
+    // Pick the LOD of each wave tile from the eye position in the grid's local space
+    // and write the matching triangle list into the current frame IB.
+    XMMATRIX world = XMLoadFloat4x4(&mWavesRitem->World);
+    XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+
+    XMFLOAT3 eyeL;
+    XMStoreFloat3(&eyeL, XMVector3TransformCoord(XMLoadFloat3(&mEyePos), invWorld));
+    mWavesLod->SelectLods(eyeL, mWavesLodDistance);
+
+    auto currWavesIB = mCurrFrameResource->WavesIB.get();
+    int indexCount = mWavesLod->WriteIndices(reinterpret_cast<std::uint32_t*>(currWavesIB->MappedData()));
+
+    D3D12_INDEX_BUFFER_VIEW& indexView = mWavesRitem->DynamicIndexBufferView;
+    indexView.BufferLocation = currWavesIB->Resource()->GetGPUVirtualAddress();
+    indexView.Format = DXGI_FORMAT_R32_UINT;
+    indexView.SizeInBytes = indexCount * sizeof(std::uint32_t);
+
+    mWavesRitem->IndexCount = indexCount;
+    mWavesRitem->StartIndexLocation = 0;
 }
 
 void ShapesApp::LoadTextures()
@@ -806,7 +924,21 @@ void ShapesApp::BuildShadersAndInputLayout()
         NULL, NULL
     };
 
-    mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_0");
+    const D3D_SHADER_MACRO wavesDefines[] =
+    {
+        "WAVES_SPLIT_STREAM", "1",
+        NULL, NULL
+    };
+
+    const D3D_SHADER_MACRO packedVertexDefines[] =
+    {
+        "PACKED_VERTEX", "1",
+        NULL, NULL
+    };
+
+    mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl",
+        mPackShapeVertices ? packedVertexDefines : nullptr, "VS", "vs_5_0");
+    mShaders["wavesVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", wavesDefines, "VS", "vs_5_0");
     mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_0");
     mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_0");
 
@@ -814,54 +946,40 @@ void ShapesApp::BuildShadersAndInputLayout()
     mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_0");
     mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_0");
 
-    mInputLayout =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
+    mInputLayout = mPackShapeVertices ? PackedVertexLayout::InputLayout() : VertexLayout::InputLayout();
+    mTreeSpriteInputLayout = TreeSpriteLayout::InputLayout();
 
-    mTreeSpriteInputLayout =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
+    // Slot 0 is the static WaterSurface::StaticVertex buffer, slot 1 the per-frame
+    // WaterSurface::StreamVertex buffer.
+    mWavesInputLayout = WaterStaticLayout::InputLayout(0);
+    WaterStreamLayout::AppendInputLayout(mWavesInputLayout, 1);
 }
 
 void ShapesApp::BuildWavesGeometry()
 {
-    std::vector<std::uint32_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-    assert(mWaves->VertexCount() < 0x0000ffff);
-
-    // Iterate over each quad.
-    int m = mWaves->RowCount();
-    int n = mWaves->ColumnCount();
-    int k = 0;
-    for (int i = 0; i < m - 1; ++i)
-    {
-        for (int j = 0; j < n - 1; ++j)
-        {
-            indices[k] = i * n + j;
-            indices[k + 1] = i * n + j + 1;
-            indices[k + 2] = (i + 1) * n + j;
+    // Each frame's triangle list is written by mWavesLod; the static index buffer
+    // holds the full-resolution grid.
+    mWavesLod = std::make_unique<WavesLod>(mWater->RowCount(), mWater->ColumnCount(), mWater->SpatialStep());
 
-            indices[k + 3] = (i + 1) * n + j;
-            indices[k + 4] = i * n + j + 1;
-            indices[k + 5] = (i + 1) * n + j + 1;
+    std::vector<std::uint32_t> indices(mWavesLod->MaxIndexCount());
+    indices.resize(mWavesLod->WriteIndices(indices.data()));
 
-            k += 6; // next quad
-        }
-    }
+    // Only the static half of the wave vertices lives in the geometry; heights and
+    // normals are streamed every frame from the frame resources.
+    std::vector<WaterSurface::StaticVertex> vertices(mWater->VertexCount());
+    mWater->WriteStaticVertices(vertices.data());
 
-    UINT vbByteSize = mWaves->VertexCount() * sizeof(Vertex);
+    UINT vbByteSize = (UINT)vertices.size() * sizeof(WaterSurface::StaticVertex);
     UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
 
     auto geo = std::make_unique<MeshGeometry>();
     geo->Name = "waterGeo";
 
-    // Set dynamically.
-    geo->VertexBufferCPU = nullptr;
-    geo->VertexBufferGPU = nullptr;
+    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+
+    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+        mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
     ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
     CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
@@ -869,7 +987,7 @@ void ShapesApp::BuildWavesGeometry()
     geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
         mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-    geo->VertexByteStride = sizeof(Vertex);
+    geo->VertexByteStride = sizeof(WaterSurface::StaticVertex);
     geo->VertexBufferByteSize = vbByteSize;
     geo->IndexFormat = DXGI_FORMAT_R32_UINT;
     geo->IndexBufferByteSize = ibByteSize;
@@ -886,7 +1004,7 @@ void ShapesApp::BuildWavesGeometry()
 
 void ShapesApp::BuildShapeGeometry()
 {
-    GeometryGenerator geoGen;
+    GeometryGenerator geoGen(mScheduler.get());
     GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3);
     GeometryGenerator::MeshData grid = geoGen.CreateGrid(60.0f, 60.0f, 60, 40);
     GeometryGenerator::MeshData sphere = geoGen.CreateSphere(1.0f, 20, 20);
@@ -898,232 +1016,45 @@ void ShapesApp::BuildShapeGeometry()
     GeometryGenerator::MeshData triangularprism = geoGen.CreateTriangularPrism(1.0f, 1.0f, 1.0f, 3);
     GeometryGenerator::MeshData pentagonalprism = geoGen.CreatePentagonalPrism(1.0f, 1.0f, 1.0f, 3);
 
-    //
-    // We are concatenating all the geometry into one big vertex/index buffer.  So
-    // define the regions in the buffer each submesh covers.
-    //
-
-    // Cache the vertex offsets to each object in the concatenated vertex buffer.
-    UINT boxVertexOffset = 0;
-    UINT gridVertexOffset = (UINT)box.Vertices.size();
-    UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-    UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-    UINT coneVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-    UINT wedgeVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-    UINT pyramidVertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
-    UINT diamondVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
-    UINT triangularprismVertexOffset = diamondVertexOffset + (UINT)diamond.Vertices.size();
-    UINT pentagonalprismVertexOffset = triangularprismVertexOffset + (UINT)triangularprism.Vertices.size();
-
-    // Cache the starting index for each object in the concatenated index buffer.
-    UINT boxIndexOffset = 0;
-    UINT gridIndexOffset = (UINT)box.Indices32.size();
-    UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-    UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-    UINT coneIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-    UINT wedgeIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-    UINT pyramidIndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size();
-    UINT diamondIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-    UINT triangularprismIndexOffset = diamondIndexOffset + (UINT)diamond.Indices32.size();
-    UINT pentagonalprismIndexOffset = triangularprismIndexOffset + (UINT)triangularprism.Indices32.size();
-
-    SubmeshGeometry boxSubmesh;
-    boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-    boxSubmesh.StartIndexLocation = boxIndexOffset;
-    boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-    SubmeshGeometry gridSubmesh;
-    gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-    gridSubmesh.StartIndexLocation = gridIndexOffset;
-    gridSubmesh.BaseVertexLocation = gridVertexOffset;
-
-    SubmeshGeometry sphereSubmesh;
-    sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-    sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-    sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-    SubmeshGeometry cylinderSubmesh;
-    cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-    cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-    cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-    SubmeshGeometry coneSubmesh;
-    coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-    coneSubmesh.StartIndexLocation = coneIndexOffset;
-    coneSubmesh.BaseVertexLocation = coneVertexOffset;
-
-    SubmeshGeometry wedgeSubmesh;
-    wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-    wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-    wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
-
-    SubmeshGeometry pyramidSubmesh;
-    pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-    pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-    pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;
-
-    SubmeshGeometry diamondSubmesh;
-    diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-    diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-    diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
-
-    SubmeshGeometry triangularprismSubmesh;
-    triangularprismSubmesh.IndexCount = (UINT)triangularprism.Indices32.size();
-    triangularprismSubmesh.StartIndexLocation = triangularprismIndexOffset;
-    triangularprismSubmesh.BaseVertexLocation = triangularprismVertexOffset;
-
-    SubmeshGeometry pentagonalprismSubmesh;
-    pentagonalprismSubmesh.IndexCount = (UINT)pentagonalprism.Indices32.size();
-    pentagonalprismSubmesh.StartIndexLocation = pentagonalprismIndexOffset;
-    pentagonalprismSubmesh.BaseVertexLocation = pentagonalprismVertexOffset;
-
-    //
-    // Extract the vertex elements we are interested in and pack the
-    // vertices of all the meshes into one vertex buffer.
-    //
-
-    auto totalVertexCount =
-        box.Vertices.size() +
-        grid.Vertices.size() +
-        sphere.Vertices.size() +
-        cylinder.Vertices.size() +
-        cone.Vertices.size() +
-        wedge.Vertices.size() +
-        pyramid.Vertices.size() +
-        diamond.Vertices.size() +
-        triangularprism.Vertices.size() +
-        pentagonalprism.Vertices.size();
-
-    std::vector<Vertex> vertices(totalVertexCount);
-
-    UINT k = 0;
-    for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = box.Vertices[i].Position;
-        vertices[k].Normal = box.Vertices[i].Normal;
-        vertices[k].TexC = box.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = grid.Vertices[i].Position;
-        vertices[k].Normal = grid.Vertices[i].Normal;
-        vertices[k].TexC = grid.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = sphere.Vertices[i].Position;
-        vertices[k].Normal = sphere.Vertices[i].Normal;
-        vertices[k].TexC = sphere.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = cylinder.Vertices[i].Position;
-        vertices[k].Normal = cylinder.Vertices[i].Normal;
-        vertices[k].TexC = cylinder.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = cone.Vertices[i].Position;
-        vertices[k].Normal = cone.Vertices[i].Normal;
-        vertices[k].TexC = cone.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
+    // Merge duplicate vertices, reorder every mesh for the post-transform vertex cache
+    // and vertex fetch, and in debug builds report the cache miss ratios before and
+    // after to the debugger output.
+    std::pair<const char*, GeometryGenerator::MeshData*> meshes[] =
     {
-        vertices[k].Pos = wedge.Vertices[i].Position;
-        vertices[k].Normal = wedge.Vertices[i].Normal;
-        vertices[k].TexC = wedge.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = pyramid.Vertices[i].Position;
-        vertices[k].Normal = pyramid.Vertices[i].Normal;
-        vertices[k].TexC = pyramid.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = diamond.Vertices[i].Position;
-        vertices[k].Normal = diamond.Vertices[i].Normal;
-        vertices[k].TexC = diamond.Vertices[i].TexC;
-    }
-
-    for (size_t i = 0; i < triangularprism.Vertices.size(); ++i, ++k)
+        { "box", &box }, { "grid", &grid }, { "sphere", &sphere }, { "cylinder", &cylinder },
+        { "cone", &cone }, { "wedge", &wedge }, { "pyramid", &pyramid }, { "diamond", &diamond },
+        { "triangularprism", &triangularprism }, { "pentagonalprism", &pentagonalprism }
+    };
+    for (auto& mesh : meshes)
     {
-        vertices[k].Pos = triangularprism.Vertices[i].Position;
-        vertices[k].Normal = triangularprism.Vertices[i].Normal;
-        vertices[k].TexC = triangularprism.Vertices[i].TexC;
-    }
+        MeshOptimizer::WeldVertices(*mesh.second);
+        MeshOptimizer::Report report = MeshOptimizer::Optimize(*mesh.second);
 
-    for (size_t i = 0; i < pentagonalprism.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = pentagonalprism.Vertices[i].Position;
-        vertices[k].Normal = pentagonalprism.Vertices[i].Normal;
-        vertices[k].TexC = pentagonalprism.Vertices[i].TexC;
+#if defined(DEBUG) || defined(_DEBUG)
+        MeshOptimizer::Trace(mesh.first, report);
+#else
+        (void)report;
+#endif
     }
 
-    std::vector<std::uint16_t> indices;
-    indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-    indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-    indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-    indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-    indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-    indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-    indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-    indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
-    indices.insert(indices.end(), std::begin(triangularprism.GetIndices16()), std::end(triangularprism.GetIndices16()));
-    indices.insert(indices.end(), std::begin(pentagonalprism.GetIndices16()), std::end(pentagonalprism.GetIndices16()));
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-    auto geo = std::make_unique<MeshGeometry>();
-    geo->Name = "shapeGeo";
-
-    ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-    CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-    CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-        mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-    geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-        mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-    geo->VertexByteStride = sizeof(Vertex);
-    geo->VertexBufferByteSize = vbByteSize;
-    geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-    geo->IndexBufferByteSize = ibByteSize;
+    //
+    // We are concatenating all the geometry into one big vertex/index buffer, with a
+    // DrawArgs entry for the region each submesh covers.
+    //
 
-    geo->DrawArgs["box"] = boxSubmesh;
-    geo->DrawArgs["grid"] = gridSubmesh;
-    geo->DrawArgs["sphere"] = sphereSubmesh;
-    geo->DrawArgs["cylinder"] = cylinderSubmesh;
-    geo->DrawArgs["cone"] = coneSubmesh;
-    geo->DrawArgs["wedge"] = wedgeSubmesh;
-    geo->DrawArgs["pyramid"] = pyramidSubmesh;
-    geo->DrawArgs["diamond"] = diamondSubmesh;
-    geo->DrawArgs["triangularprism"] = triangularprismSubmesh;
-    geo->DrawArgs["pentagonalprism"] = pentagonalprismSubmesh;
+    MeshBatchBuilder batch(mScheduler.get());
+    for (auto& mesh : meshes)
+        batch.Add(mesh.first, *mesh.second);
 
+    auto geo = mPackShapeVertices ?
+        batch.Build<PackedVertexLayout>("shapeGeo", md3dDevice.Get(), mCommandList.Get()) :
+        batch.Build<VertexLayout>("shapeGeo", md3dDevice.Get(), mCommandList.Get());
     mGeometries[geo->Name] = std::move(geo);
 }
 
 void ShapesApp::BuildTreeSpritesGeometry()
 {
     //step5
-    struct TreeSpriteVertex
-    {
-        XMFLOAT3 Pos;
-        XMFLOAT2 Size;
-    };
     static const int treeCount = 15;
     int TreeIndex = 0;
     std::array<TreeSpriteVertex, treeCount> vertices;
@@ -1263,6 +1194,19 @@ void ShapesApp::BuildPSOs()
     transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
     ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
 
+    //
+    // PSO for the water, which reads its vertices from two streams.
+    //
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC transparentWavesPsoDesc = transparentPsoDesc;
+    transparentWavesPsoDesc.InputLayout = { mWavesInputLayout.data(), (UINT)mWavesInputLayout.size() };
+    transparentWavesPsoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(mShaders["wavesVS"]->GetBufferPointer()),
+        mShaders["wavesVS"]->GetBufferSize()
+    };
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentWavesPsoDesc, IID_PPV_ARGS(&mPSOs["transparentWaves"])));
+
     //
     // PSO for alpha tested objects
     //
@@ -1308,7 +1252,8 @@ void ShapesApp::BuildFrameResources()
     for (int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWater->VertexCount(),
+            mWavesLod->MaxIndexCount()));
     }
 }
 
@@ -1430,14 +1375,12 @@ void ShapesApp::BuildRenderItems()
     wavesRitem->Mat = mMaterials["water"].get();
     wavesRitem->Geo = mGeometries["waterGeo"].get();
     wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["water"].IndexCount;
-    wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["water"].StartIndexLocation;
-    wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["water"].BaseVertexLocation;
+    wavesRitem->SetSubmesh(wavesRitem->Geo->DrawArgs["water"]);
 
     // we use mVavesRitem in updatewaves() to set the dynamic VB of the wave renderitem to the current frame VB.
     mWavesRitem = wavesRitem.get();
 
-    mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
+    mRitemLayer[(int)RenderLayer::TransparentWaves].push_back(wavesRitem.get());
     mAllRitems.push_back(std::move(wavesRitem));
 
     auto treeSpritesRitem = std::make_unique<RenderItem>();
@@ -1447,9 +1390,7 @@ void ShapesApp::BuildRenderItems()
     treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
     //step2
     treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-    treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-    treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-    treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
+    treeSpritesRitem->SetSubmesh(treeSpritesRitem->Geo->DrawArgs["points"]);
     mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
     mAllRitems.push_back(std::move(treeSpritesRitem));
 
@@ -1460,9 +1401,7 @@ void ShapesApp::BuildRenderItems()
     boxRItem->Mat = mMaterials["bricks0"].get();
     boxRItem->Geo = mGeometries["shapeGeo"].get();
     boxRItem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    boxRItem->IndexCount = boxRItem->Geo->DrawArgs["box"].IndexCount;
-    boxRItem->StartIndexLocation = boxRItem->Geo->DrawArgs["box"].StartIndexLocation;
-    boxRItem->BaseVertexLocation = boxRItem->Geo->DrawArgs["box"].BaseVertexLocation;
+    boxRItem->SetSubmesh(boxRItem->Geo->DrawArgs["box"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRItem.get());
     mAllRitems.push_back(std::move(boxRItem));
 
@@ -1474,9 +1413,7 @@ void ShapesApp::BuildRenderItems()
     pyramidRitem->Mat = mMaterials["roof0"].get();
     pyramidRitem->Geo = mGeometries["shapeGeo"].get();
     pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-    pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-    pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
+    pyramidRitem->SetSubmesh(pyramidRitem->Geo->DrawArgs["pyramid"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(pyramidRitem.get());
     mAllRitems.push_back(std::move(pyramidRitem));
 
@@ -1486,9 +1423,7 @@ void ShapesApp::BuildRenderItems()
     pentagonalprismRitem->Mat = mMaterials["lantern0"].get();
     pentagonalprismRitem->Geo = mGeometries["shapeGeo"].get();
     pentagonalprismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    pentagonalprismRitem->IndexCount = pentagonalprismRitem->Geo->DrawArgs["pentagonalprism"].IndexCount;
-    pentagonalprismRitem->StartIndexLocation = pentagonalprismRitem->Geo->DrawArgs["pentagonalprism"].StartIndexLocation;
-    pentagonalprismRitem->BaseVertexLocation = pentagonalprismRitem->Geo->DrawArgs["pentagonalprism"].BaseVertexLocation;
+    pentagonalprismRitem->SetSubmesh(pentagonalprismRitem->Geo->DrawArgs["pentagonalprism"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(pentagonalprismRitem.get());
     mAllRitems.push_back(std::move(pentagonalprismRitem));
 
@@ -1503,9 +1438,7 @@ void ShapesApp::BuildRenderItems()
         boxRItem->Mat = mMaterials["bricks0"].get();
         boxRItem->Geo = mGeometries["shapeGeo"].get();
         boxRItem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        boxRItem->IndexCount = boxRItem->Geo->DrawArgs["box"].IndexCount;
-        boxRItem->StartIndexLocation = boxRItem->Geo->DrawArgs["box"].StartIndexLocation;
-        boxRItem->BaseVertexLocation = boxRItem->Geo->DrawArgs["box"].BaseVertexLocation;
+        boxRItem->SetSubmesh(boxRItem->Geo->DrawArgs["box"]);
         mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRItem.get());
         mAllRitems.push_back(std::move(boxRItem));
 
@@ -1520,9 +1453,7 @@ void ShapesApp::BuildRenderItems()
         wedgeRitem->Mat = mMaterials["roof0"].get();
         wedgeRitem->Geo = mGeometries["shapeGeo"].get();
         wedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        wedgeRitem->IndexCount = wedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-        wedgeRitem->StartIndexLocation = wedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-        wedgeRitem->BaseVertexLocation = wedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
+        wedgeRitem->SetSubmesh(wedgeRitem->Geo->DrawArgs["wedge"]);
         mRitemLayer[(int)RenderLayer::Opaque].push_back(wedgeRitem.get());
         mAllRitems.push_back(std::move(wedgeRitem));
 
@@ -1533,9 +1464,7 @@ void ShapesApp::BuildRenderItems()
         wedgeRitem->Mat = mMaterials["roof0"].get();
         wedgeRitem->Geo = mGeometries["shapeGeo"].get();
         wedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        wedgeRitem->IndexCount = wedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-        wedgeRitem->StartIndexLocation = wedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-        wedgeRitem->BaseVertexLocation = wedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
+        wedgeRitem->SetSubmesh(wedgeRitem->Geo->DrawArgs["wedge"]);
         mRitemLayer[(int)RenderLayer::Opaque].push_back(wedgeRitem.get());
         mAllRitems.push_back(std::move(wedgeRitem));
 
@@ -1549,9 +1478,7 @@ void ShapesApp::BuildRenderItems()
         wedgeRitem->Mat = mMaterials["roof0"].get();
         wedgeRitem->Geo = mGeometries["shapeGeo"].get();
         wedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        wedgeRitem->IndexCount = wedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-        wedgeRitem->StartIndexLocation = wedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-        wedgeRitem->BaseVertexLocation = wedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
+        wedgeRitem->SetSubmesh(wedgeRitem->Geo->DrawArgs["wedge"]);
         mRitemLayer[(int)RenderLayer::Opaque].push_back(wedgeRitem.get());
         mAllRitems.push_back(std::move(wedgeRitem));
 
@@ -1562,9 +1489,7 @@ void ShapesApp::BuildRenderItems()
         wedgeRitem->Mat = mMaterials["roof0"].get();
         wedgeRitem->Geo = mGeometries["shapeGeo"].get();
         wedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        wedgeRitem->IndexCount = wedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-        wedgeRitem->StartIndexLocation = wedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-        wedgeRitem->BaseVertexLocation = wedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
+        wedgeRitem->SetSubmesh(wedgeRitem->Geo->DrawArgs["wedge"]);
         mRitemLayer[(int)RenderLayer::Opaque].push_back(wedgeRitem.get());
         mAllRitems.push_back(std::move(wedgeRitem));
 
@@ -1579,9 +1504,7 @@ void ShapesApp::BuildRenderItems()
             pentagonalprismRitem->Mat = mMaterials["lantern0"].get();
             pentagonalprismRitem->Geo = mGeometries["shapeGeo"].get();
             pentagonalprismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-            pentagonalprismRitem->IndexCount = pentagonalprismRitem->Geo->DrawArgs["pentagonalprism"].IndexCount;
-            pentagonalprismRitem->StartIndexLocation = pentagonalprismRitem->Geo->DrawArgs["pentagonalprism"].StartIndexLocation;
-            pentagonalprismRitem->BaseVertexLocation = pentagonalprismRitem->Geo->DrawArgs["pentagonalprism"].BaseVertexLocation;
+            pentagonalprismRitem->SetSubmesh(pentagonalprismRitem->Geo->DrawArgs["pentagonalprism"]);
             mRitemLayer[(int)RenderLayer::Opaque].push_back(pentagonalprismRitem.get());
             mAllRitems.push_back(std::move(pentagonalprismRitem));
         }
@@ -1599,9 +1522,7 @@ void ShapesApp::BuildRenderItems()
             coneRitem->Mat = mMaterials["green"].get();
             coneRitem->Geo = mGeometries["shapeGeo"].get();
             coneRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-            coneRitem->IndexCount = coneRitem->Geo->DrawArgs["cone"].IndexCount;
-            coneRitem->StartIndexLocation = coneRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-            coneRitem->BaseVertexLocation = coneRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
+            coneRitem->SetSubmesh(coneRitem->Geo->DrawArgs["cone"]);
             mRitemLayer[(int)RenderLayer::Opaque].push_back(coneRitem.get());
             mAllRitems.push_back(std::move(coneRitem));
 
@@ -1611,9 +1532,7 @@ void ShapesApp::BuildRenderItems()
             cylinderRitem->Mat = mMaterials["wood"].get();
             cylinderRitem->Geo = mGeometries["shapeGeo"].get();
             cylinderRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-            cylinderRitem->IndexCount = cylinderRitem->Geo->DrawArgs["cylinder"].IndexCount;
-            cylinderRitem->StartIndexLocation = cylinderRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-            cylinderRitem->BaseVertexLocation = cylinderRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+            cylinderRitem->SetSubmesh(cylinderRitem->Geo->DrawArgs["cylinder"]);
             mRitemLayer[(int)RenderLayer::Opaque].push_back(cylinderRitem.get());
             mAllRitems.push_back(std::move(cylinderRitem));
         }
@@ -1628,9 +1547,7 @@ void ShapesApp::BuildRenderItems()
     triangularprismRitem->Mat = mMaterials["roof0"].get();
     triangularprismRitem->Geo = mGeometries["shapeGeo"].get();
     triangularprismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    triangularprismRitem->IndexCount = triangularprismRitem->Geo->DrawArgs["triangularprism"].IndexCount;
-    triangularprismRitem->StartIndexLocation = triangularprismRitem->Geo->DrawArgs["triangularprism"].StartIndexLocation;
-    triangularprismRitem->BaseVertexLocation = triangularprismRitem->Geo->DrawArgs["triangularprism"].BaseVertexLocation;
+    triangularprismRitem->SetSubmesh(triangularprismRitem->Geo->DrawArgs["triangularprism"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(triangularprismRitem.get());
     mAllRitems.push_back(std::move(triangularprismRitem));
 
@@ -1642,9 +1559,7 @@ void ShapesApp::BuildRenderItems()
     triangularprismRitem->Mat = mMaterials["roof0"].get();
     triangularprismRitem->Geo = mGeometries["shapeGeo"].get();
     triangularprismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    triangularprismRitem->IndexCount = triangularprismRitem->Geo->DrawArgs["triangularprism"].IndexCount;
-    triangularprismRitem->StartIndexLocation = triangularprismRitem->Geo->DrawArgs["triangularprism"].StartIndexLocation;
-    triangularprismRitem->BaseVertexLocation = triangularprismRitem->Geo->DrawArgs["triangularprism"].BaseVertexLocation;
+    triangularprismRitem->SetSubmesh(triangularprismRitem->Geo->DrawArgs["triangularprism"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(triangularprismRitem.get());
     mAllRitems.push_back(std::move(triangularprismRitem));
 
@@ -1658,9 +1573,7 @@ void ShapesApp::BuildRenderItems()
         pyramidRitem->Mat = mMaterials["roof0"].get();
         pyramidRitem->Geo = mGeometries["shapeGeo"].get();
         pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-        pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-        pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
+        pyramidRitem->SetSubmesh(pyramidRitem->Geo->DrawArgs["pyramid"]);
         mRitemLayer[(int)RenderLayer::Opaque].push_back(pyramidRitem.get());
         mAllRitems.push_back(std::move(pyramidRitem));
     }
@@ -1678,9 +1591,7 @@ void ShapesApp::BuildRenderItems()
             pyramidRitem->Mat = mMaterials["roof0"].get();
             pyramidRitem->Geo = mGeometries["shapeGeo"].get();
             pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-            pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-            pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-            pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
+            pyramidRitem->SetSubmesh(pyramidRitem->Geo->DrawArgs["pyramid"]);
             mRitemLayer[(int)RenderLayer::Opaque].push_back(pyramidRitem.get());
             mAllRitems.push_back(std::move(pyramidRitem));
         }
@@ -1694,9 +1605,7 @@ void ShapesApp::BuildRenderItems()
     pyramidRitem->Mat = mMaterials["roof0"].get();
     pyramidRitem->Geo = mGeometries["shapeGeo"].get();
     pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-    pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-    pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
+    pyramidRitem->SetSubmesh(pyramidRitem->Geo->DrawArgs["pyramid"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(pyramidRitem.get());
     mAllRitems.push_back(std::move(pyramidRitem));
 
@@ -1708,9 +1617,7 @@ void ShapesApp::BuildRenderItems()
     triangularprismRitem->Mat = mMaterials["roof0"].get();
     triangularprismRitem->Geo = mGeometries["shapeGeo"].get();
     triangularprismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    triangularprismRitem->IndexCount = triangularprismRitem->Geo->DrawArgs["triangularprism"].IndexCount;
-    triangularprismRitem->StartIndexLocation = triangularprismRitem->Geo->DrawArgs["triangularprism"].StartIndexLocation;
-    triangularprismRitem->BaseVertexLocation = triangularprismRitem->Geo->DrawArgs["triangularprism"].BaseVertexLocation;
+    triangularprismRitem->SetSubmesh(triangularprismRitem->Geo->DrawArgs["triangularprism"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(triangularprismRitem.get());
     mAllRitems.push_back(std::move(triangularprismRitem));
 
@@ -1723,9 +1630,7 @@ void ShapesApp::BuildRenderItems()
         diamondRitem->Mat = mMaterials["yellow"].get();
         diamondRitem->Geo = mGeometries["shapeGeo"].get();
         diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-        diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-        diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
+        diamondRitem->SetSubmesh(diamondRitem->Geo->DrawArgs["diamond"]);
         mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem.get());
         mAllRitems.push_back(std::move(diamondRitem));
     }
@@ -1739,9 +1644,7 @@ void ShapesApp::BuildRenderItems()
         diamondRitem->Mat = mMaterials["yellow"].get();
         diamondRitem->Geo = mGeometries["shapeGeo"].get();
         diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-        diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-        diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-        diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
+        diamondRitem->SetSubmesh(diamondRitem->Geo->DrawArgs["diamond"]);
         mRitemLayer[(int)RenderLayer::Opaque].push_back(diamondRitem.get());
         mAllRitems.push_back(std::move(diamondRitem));
     }
@@ -1757,9 +1660,7 @@ void ShapesApp::BuildRenderItems()
             sphereRitem->Mat = mMaterials["lantern0"].get();
             sphereRitem->Geo = mGeometries["shapeGeo"].get();
             sphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-            sphereRitem->IndexCount = sphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-            sphereRitem->StartIndexLocation = sphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-            sphereRitem->BaseVertexLocation = sphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+            sphereRitem->SetSubmesh(sphereRitem->Geo->DrawArgs["sphere"]);
             mRitemLayer[(int)RenderLayer::Opaque].push_back(sphereRitem.get());
             mAllRitems.push_back(std::move(sphereRitem));
         }
@@ -1772,9 +1673,7 @@ void ShapesApp::BuildRenderItems()
     sphereRitem->Mat = mMaterials["bricks0"].get();
     sphereRitem->Geo = mGeometries["shapeGeo"].get();
     sphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    sphereRitem->IndexCount = sphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-    sphereRitem->StartIndexLocation = sphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-    sphereRitem->BaseVertexLocation = sphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+    sphereRitem->SetSubmesh(sphereRitem->Geo->DrawArgs["sphere"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(sphereRitem.get());
     mAllRitems.push_back(std::move(sphereRitem));
 
@@ -1786,9 +1685,7 @@ void ShapesApp::BuildRenderItems()
     gridRitem->Mat = mMaterials["tile0"].get();
     gridRitem->Geo = mGeometries["shapeGeo"].get();
     gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-    gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-    gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+    gridRitem->SetSubmesh(gridRitem->Geo->DrawArgs["grid"]);
     mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
     mAllRitems.push_back(std::move(gridRitem));
 
@@ -1810,8 +1707,19 @@ void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
     {
         auto ri = ritems[i];
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+        if (ri->StreamVertexBufferView.BufferLocation != 0)
+        {
+            D3D12_VERTEX_BUFFER_VIEW views[] = { ri->Geo->VertexBufferView(), ri->StreamVertexBufferView };
+            cmdList->IASetVertexBuffers(0, 2, views);
+        }
+        else
+        {
+            cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+        }
+        if (ri->DynamicIndexBufferView.BufferLocation != 0)
+            cmdList->IASetIndexBuffer(&ri->DynamicIndexBufferView);
+        else
+            cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
         CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());